@@ -3,11 +3,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <assert.h>
-
-#ifndef CORO_LOCAL_DATA
-#error "You are expected to specify what you want to store in a coroutine "\
-       "via CORO_LOCAL_DATA"
-#endif
+#include <string.h>
 
 /**
  * Coroutines library. It allows to split execution of a task
@@ -44,8 +40,42 @@
  *     coro_finish();
  *     coro_wait_all();
  * }
+ *
+ *
+ * Local variables of the coroutines are not safe to use, so
+ * each data, living across yields, should be stored in
+ * coroutine-local storage:
+ *
+ *
+ * struct my_data {
+ *     int a;
+ * };
+ * static coro_key_t my_key;
+ *
+ * coro_key_create(&my_key, sizeof(struct my_data), NULL);
+ * ...
+ * coro_local(my_key, struct my_data)->a = 100;
  */
 
+/** Maximal number of coroutine-local storage keys. */
+#define CORO_KEYS_MAX 64
+
+/** Identifier of a coroutine-local value. */
+typedef int coro_key_t;
+
+/** Description of a coroutine-local value, shared by all coros. */
+struct coro_key_def {
+	/** Size of the value. */
+	size_t size;
+	/** Called on the value before it is freed. Can be NULL. */
+	void (*destructor)(void *);
+};
+
+/** Registry of all the created keys. */
+static struct coro_key_def coro_keys[CORO_KEYS_MAX];
+/** Number of created keys. The next key gets this value. */
+static int coro_key_count = 0;
+
 /**
  * This struct describes one single coroutine. It stores its
  * local variables and a position, where it stands now.
@@ -73,15 +103,31 @@ struct coro {
 	 * finished.
 	 */
 	bool is_finished;
-	CORO_LOCAL_DATA;
+	/**
+	 * Coroutine-local values, indexed by a key. The array and
+	 * the values are allocated only on a first access, so a
+	 * coroutine pays only for the keys it really uses.
+	 */
+	void **locals;
+	/** Number of slots in the array above. */
+	int local_capacity;
 };
 
 /**
  * In your code it should be dynamic, not const. Here it is 3 for
  * simplicity.
  */
+#ifndef coro_count
 #define coro_count 3
-static struct coro coros[coro_count];
+#endif
+/**
+ * Size of the coroutines array. coro_count can be defined as a
+ * variable, then this should be defined as its maximal value.
+ */
+#ifndef CORO_COUNT_MAX
+#define CORO_COUNT_MAX coro_count
+#endif
+static struct coro coros[CORO_COUNT_MAX];
 
 /**
  * Index of the currently working coroutine. It is used to learn
@@ -93,8 +139,78 @@ static int curr_coro_i = 0;
 /** Get currently working coroutine. */
 #define coro_this() (&coros[curr_coro_i])
 
-/** Declare that this curoutine has finished. */
-#define coro_finish() ({ coro_this()->is_finished = true; })
+/**
+ * Create a new coroutine-local storage key. Each coroutine gets
+ * its own zero-filled value of @a size bytes under that key.
+ * @retval 0 Success, the key is stored into @a key.
+ * @retval -1 Too many keys.
+ */
+static inline int
+coro_key_create(coro_key_t *key, size_t size, void (*destructor)(void *))
+{
+	if (coro_key_count == CORO_KEYS_MAX)
+		return -1;
+	coro_keys[coro_key_count].size = size;
+	coro_keys[coro_key_count].destructor = destructor;
+	*key = coro_key_count++;
+	return 0;
+}
+
+/** Slow path of coro_local_get() - allocate the value. */
+static inline void *
+coro_local_new(struct coro *c, coro_key_t key)
+{
+	if (key >= c->local_capacity) {
+		int new_cap = key + 1;
+		c->locals = (void **) realloc(c->locals,
+					      new_cap * sizeof(void *));
+		assert(c->locals != NULL);
+		memset(c->locals + c->local_capacity, 0,
+		       (new_cap - c->local_capacity) * sizeof(void *));
+		c->local_capacity = new_cap;
+	}
+	c->locals[key] = calloc(1, coro_keys[key].size);
+	assert(c->locals[key] != NULL);
+	return c->locals[key];
+}
+
+/** Get a coroutine-local value of coroutine @a c by a key. */
+static inline void *
+coro_local_get(struct coro *c, coro_key_t key)
+{
+	assert(key >= 0 && key < coro_key_count);
+	if (key < c->local_capacity && c->locals[key] != NULL)
+		return c->locals[key];
+	return coro_local_new(c, key);
+}
+
+/** Free all the local values of a coroutine. */
+static inline void
+coro_local_free(struct coro *c)
+{
+	for (int i = 0; i < c->local_capacity; ++i) {
+		if (c->locals[i] == NULL)
+			continue;
+		if (coro_keys[i].destructor != NULL)
+			coro_keys[i].destructor(c->locals[i]);
+		free(c->locals[i]);
+	}
+	free(c->locals);
+	c->locals = NULL;
+	c->local_capacity = 0;
+}
+
+/** Get a local value of the current coroutine as @a type. */
+#define coro_local(key, type) ((type *) coro_local_get(coro_this(), (key)))
+
+/**
+ * Declare that this curoutine has finished. Its local values
+ * are destroyed.
+ */
+#define coro_finish() ({					\
+	coro_local_free(coro_this());				\
+	coro_this()->is_finished = true;			\
+})
 
 /**
  * This macro stops the current coroutine and switches to another
@@ -116,6 +232,8 @@ static int curr_coro_i = 0;
 	(coro)->ret_count = 0;					\
 	(coro)->ret_capacity = 0;				\
 	(coro)->ret_points = NULL;				\
+	(coro)->locals = NULL;					\
+	(coro)->local_capacity = 0;				\
 	setjmp((coro)->exec_point);				\
 })
 
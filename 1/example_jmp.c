@@ -1,8 +1,3 @@
-#define CORO_LOCAL_DATA struct {				\
-	int deep;						\
-	char local_data[128];					\
-	int arg;						\
-}
 #include "coro_jmp.h"
 
 /**
@@ -12,6 +7,19 @@
  * $> ./a.out
  */
 
+/** Data, stored by each coroutine across yields. */
+struct my_coro_data {
+	int deep;
+	char local_data[128];
+	int arg;
+};
+
+/** Key of struct my_coro_data in coroutine-local storage. */
+static coro_key_t my_data_key;
+
+/** Get struct my_coro_data of the current coroutine. */
+#define my_data() coro_local(my_data_key, struct my_coro_data)
+
 /**
  * A function, called from inside of coroutines, and even
  * recursively.
@@ -20,16 +28,16 @@ static void
 other_function(int arg)
 {
 	printf("Coro %d: entered function, deep = %d, arg = %d\n", curr_coro_i,
-	       coro_this()->deep, arg);
-	coro_this()->arg = arg;
+	       my_data()->deep, arg);
+	my_data()->arg = arg;
 	coro_yield();
-	printf("Coro %d: after yield arg = %d, but coro_this()->arg = %d\n",
-		curr_coro_i, arg, coro_this()->arg);
+	printf("Coro %d: after yield arg = %d, but my_data()->arg = %d\n",
+		curr_coro_i, arg, my_data()->arg);
 	/*
 	 * Here I've decided to call it recursively 2 times in
 	 * each coro.
 	 */
-	if (++coro_this()->deep < 2)
+	if (++my_data()->deep < 2)
 		coro_call(other_function, curr_coro_i * 10);
 	coro_return();
 }
@@ -43,11 +51,11 @@ static void
 my_coroutine()
 {
 	/*
-	 * Note - all the data access is done via 'coro_this()'.
+	 * Note - all the data access is done via 'my_data()'.
 	 * It is not safe to store anything in local variables
 	 * here.
 	 */
-	sprintf(coro_this()->local_data, "Local data for coro id%d",
+	sprintf(my_data()->local_data, "Local data for coro id%d",
 		curr_coro_i);
 	fprintf(stderr, "Coro %d: before re-schedule\n", curr_coro_i);
 	coro_yield();
@@ -57,7 +65,7 @@ my_coroutine()
 	/* Other functions can be called, but via coro_call(). */
 	coro_call(other_function, curr_coro_i * 10);
 	fprintf(stderr, "Coro %d: this is local data: %s\n", curr_coro_i,
-		coro_this()->local_data);
+		my_data()->local_data);
 	coro_finish();
 	coro_wait_all();
 }
@@ -65,6 +73,7 @@ my_coroutine()
 int
 main(int argc, char **argv)
 {
+	coro_key_create(&my_data_key, sizeof(struct my_coro_data), NULL);
 	for (int i = 0; i < coro_count; ++i) {
 		if (coro_init(&coros[i]) != 0)
 			break;
@@ -2,6 +2,7 @@
 #include <ucontext.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <limits.h>
 #include <signal.h>
@@ -14,8 +15,24 @@
 
 #define micro_secs(a) (1000000*(a)/CLOCKS_PER_SEC)
 
+#define WEIGHT_DEFAULT 100
+#define LATENCY_DEFAULT 100000
+
+//how the next coroutine is chosen on swap
+enum sched_policy{
+	//next alive in turn
+	POLICY_RR,
+	//alive with the biggest priority, equal ones in turn
+	POLICY_PRIORITY,
+	//alive with the smallest work time divided by weight
+	POLICY_FAIR,
+	//alive with the earliest deadline: swap out time + latency
+	POLICY_DEADLINE
+};
+
 static ucontext_t uctx_main;
 static unsigned long timeslice;
+static int sched_policy = POLICY_RR;
 
 static void* allocate_stack()
 {
@@ -41,6 +58,11 @@ struct context_data{
 	int swap_count;
 	unsigned long time_work;
 	unsigned long timestamp;
+	int priority;
+	int weight;
+	unsigned long latency;
+	unsigned long vruntime;
+	unsigned long deadline;
 	ucontext_t uctx_my;
 };
 
@@ -80,63 +102,88 @@ struct buffer* insert_buffer(struct buffer* buf, int n)
 	return buf;
 }
 
-//set ucontext to swich after end of coroutine
-//track time
-void terminate(struct context_data data[], int n, int size)
+//true if coroutine a should run before b
+char is_better(struct context_data* a, struct context_data* b)
+{
+	switch(sched_policy){
+	case POLICY_PRIORITY:
+		return a->priority > b->priority;
+	case POLICY_FAIR:
+		return a->vruntime < b->vruntime;
+	case POLICY_DEADLINE:
+		return a->deadline < b->deadline;
+	}
+	return 0;
+}
+
+//choose alive coroutine to run after n according to policy
+//coroutines are checked in turn starting from n+1, n is the last
+//return -1 if all are finished
+int pick_next(struct context_data data[], int n, int size)
 {
 	int i;
-	data[n].finished = 1;
-	data[n].time_work += micro_secs(clock()) - data[n].timestamp;
-	for(i = n+1; i < size; i++){
-		if(data[i].finished == 1){
+	int best = -1;
+	for(i = 1; i <= size; i++){
+		int k = (n + i) % size;
+		if(data[k].finished == 1){
 			continue;
 		}
-		data[n].uctx_my.uc_link = &data[i].uctx_my;
-		return;
-	}
-	for(i = 0; i < n; i++){
-		if(data[i].finished == 1){
-			continue;
+		if(best == -1 || is_better(&data[k], &data[best])){
+			best = k;
 		}
-		data[n].uctx_my.uc_link = &data[i].uctx_my;
-		return;
+		if(sched_policy == POLICY_RR){
+			break;
+		}
+	}
+	return best;
+}
+
+//track time
+void account_time(struct context_data data[], int n)
+{
+	unsigned long now = micro_secs(clock());
+	unsigned long delta = now - data[n].timestamp;
+	data[n].time_work += delta;
+	data[n].vruntime += delta * WEIGHT_DEFAULT / data[n].weight;
+	data[n].deadline = now + data[n].latency;
+	data[n].timestamp = now;
+}
+
+//switch to next coroutine after end of this one
+//uc_link is copied by makecontext, so it can't be changed here
+//track time
+void terminate(struct context_data data[], int n, int size)
+{
+	int i;
+	data[n].finished = 1;
+	account_time(data, n);
+	i = pick_next(data, n, size);
+	if(i == -1){
+		setcontext(&uctx_main);
+	}else{
+		setcontext(&data[i].uctx_my);
 	}
-	data[n].uctx_my.uc_link = &uctx_main;
+	handle_error("setcontext");
 }
 
-//swap to first alive coroutine
+//swap to next coroutine chosen by policy
 //track time
 void swap(struct context_data data[], int n, int size)
 {
 	int i;
-	unsigned long time;
 	if(micro_secs(clock()) - data[n].timestamp < timeslice){
 		return;
 	}
-	for(i = n+1; i < size; i++){
-		if(data[i].finished == 1){
-			continue;
-		}
-		data[n].time_work += micro_secs(clock()) - data[n].timestamp;
-		data[n].swap_count++;
-		if(swapcontext(&data[n].uctx_my, &data[i].uctx_my) == -1){
-			handle_error("swapcontext");
-		}
-		data[n].timestamp = micro_secs(clock());
+	account_time(data, n);
+	i = pick_next(data, n, size);
+	if(i == n){
 		return;
 	}
-	for(i = 0; i < n; i++){
-		if(data[i].finished == 1){
-			continue;
-		}
-		data[n].time_work += micro_secs(clock()) - data[n].timestamp;
-		data[n].swap_count++;
-		if(swapcontext(&data[n].uctx_my, &data[i].uctx_my) == -1){
-			handle_error("swapcontext");
-		}
-		data[n].timestamp = micro_secs(clock());
-		return;
+	data[n].swap_count++;
+	if(swapcontext(&data[n].uctx_my, &data[i].uctx_my) == -1){
+		handle_error("swapcontext");
 	}
+	data[n].timestamp = micro_secs(clock());
 }
 
 int part(int* a, int l, int r)
@@ -227,8 +274,60 @@ void merge_files(struct context_data data[], int n, FILE* file)
 	}
 }
 
+int parse_policy(char* name)
+{
+	if(strcmp(name, "rr") == 0){
+		return POLICY_RR;
+	}
+	if(strcmp(name, "prio") == 0){
+		return POLICY_PRIORITY;
+	}
+	if(strcmp(name, "fair") == 0){
+		return POLICY_FAIR;
+	}
+	if(strcmp(name, "edf") == 0){
+		return POLICY_DEADLINE;
+	}
+	printf("unknown policy %s\n", name);
+	exit(EXIT_FAILURE);
+}
+
+//file name can be followed by :N - priority, weight or latency
+//in microseconds, depending on the policy
+void parse_file_arg(char* arg, struct context_data* data)
+{
+	char* sep = strrchr(arg, ':');
+	int value;
+	data->priority = 0;
+	data->weight = WEIGHT_DEFAULT;
+	data->latency = LATENCY_DEFAULT;
+	if(sep == NULL || sep[1] == 0 ||
+		strspn(sep + 1, "0123456789") != strlen(sep + 1)){
+		return;
+	}
+	*sep = 0;
+	value = atoi(sep + 1);
+	switch(sched_policy){
+	case POLICY_PRIORITY:
+		data->priority = value;
+		break;
+	case POLICY_FAIR:
+		data->weight = value > 0 ? value : 1;
+		break;
+	case POLICY_DEADLINE:
+		data->latency = value;
+		break;
+	}
+}
+
+//usage: [-p rr|prio|fair|edf] timeslice file[:N]...
 int main(int argc, char** argv)
 {
+	if(argc > 2 && strcmp(argv[1], "-p") == 0){
+		sched_policy = parse_policy(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
 	if(argc < 3){
 		printf("no jobs to do\n");
 		return 0;
@@ -241,6 +340,7 @@ int main(int argc, char** argv)
 	struct context_data data[coroutines_num];
 	//init uctx
 	for(i = 0; i < coroutines_num; i++){
+		parse_file_arg(argv[i+2], &data[i]);
 		FILE* f = fopen(argv[i+2], "r+");
 		if(f == NULL){
 			handle_error("file not opened");
@@ -250,11 +350,14 @@ int main(int argc, char** argv)
 		data[i].finished = 0;
 		data[i].time_work = 0;
 		data[i].swap_count = 0;
+		data[i].vruntime = 0;
+		data[i].deadline = data[i].latency;
 		char* stack = allocate_stack();
 		if (getcontext(&data[i].uctx_my) == -1)
 			handle_error("getcontext");
 		data[i].uctx_my.uc_stack.ss_sp = stack;
 		data[i].uctx_my.uc_stack.ss_size = STACK_SIZE;
+		data[i].uctx_my.uc_link = &uctx_main;
 	}
 	//start uctx
 	for(i = 0; i < coroutines_num; i++){
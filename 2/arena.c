@@ -0,0 +1,82 @@
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct arena_chunk* new_arena_chunk(int size)
+{
+	struct arena_chunk* chunk = (struct arena_chunk*)malloc(
+		sizeof(struct arena_chunk) + size);
+	if(chunk == NULL){
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->pos = 0;
+	return chunk;
+}
+
+void arena_create(struct arena* a)
+{
+	a->first = NULL;
+	a->curr = NULL;
+}
+
+void* arena_alloc(struct arena* a, int size)
+{
+	struct arena_chunk* chunk = a->curr;
+	void* res;
+	size = (size + 7) & ~7;
+	while(chunk && chunk->pos + size > chunk->size){
+		chunk = chunk->next;
+	}
+	if(chunk == NULL){
+		chunk = new_arena_chunk(size > ARENA_CHUNK_SIZE ?
+			size : ARENA_CHUNK_SIZE);
+		if(a->curr){
+			chunk->next = a->curr->next;
+			a->curr->next = chunk;
+		}else{
+			a->first = chunk;
+		}
+	}
+	a->curr = chunk;
+	res = &chunk->data[chunk->pos];
+	chunk->pos += size;
+	return res;
+}
+
+char* arena_strdup(struct arena* a, const char* str, int len)
+{
+	char* res = (char*)arena_alloc(a, len + 1);
+	memcpy(res, str, len);
+	res[len] = 0;
+	return res;
+}
+
+void arena_reset(struct arena* a)
+{
+	struct arena_chunk** p = &a->first;
+	while(*p){
+		struct arena_chunk* chunk = *p;
+		if(chunk->size > ARENA_CHUNK_SIZE){
+			*p = chunk->next;
+			free(chunk);
+			continue;
+		}
+		chunk->pos = 0;
+		p = &chunk->next;
+	}
+	a->curr = a->first;
+}
+
+void arena_destroy(struct arena* a)
+{
+	while(a->first){
+		struct arena_chunk* chunk = a->first;
+		a->first = chunk->next;
+		free(chunk);
+	}
+	a->curr = NULL;
+}
@@ -0,0 +1,32 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#define ARENA_CHUNK_SIZE 16384
+
+struct arena_chunk{
+	struct arena_chunk* next;
+	int size;
+	int pos;
+	char data[];
+};
+
+//bump allocator for everything, which lives until the end of
+//one command line execution
+struct arena{
+	struct arena_chunk* first;
+	struct arena_chunk* curr;
+};
+
+void arena_create(struct arena* a);
+
+void* arena_alloc(struct arena* a, int size);
+
+char* arena_strdup(struct arena* a, const char* str, int len);
+
+//free all allocations at once, chunks of the default size are
+//kept for next allocations
+void arena_reset(struct arena* a);
+
+void arena_destroy(struct arena* a);
+
+#endif
@@ -0,0 +1,272 @@
+#include "builtin.h"
+#include "pathhash.h"
+#include "jobs.h"
+#include "stream.h"
+#include "parallel.h"
+#include "vars.h"
+#include "history.h"
+#include "coproc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdbool.h>
+
+#define READ_LINE_BLOCK 4096
+
+static int builtin_cd(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : var_get("HOME");
+	if(path == NULL){
+		fprintf(stderr, "cd: HOME not set\n");
+		return 1;
+	}
+	if(chdir(path) != 0){
+		fprintf(stderr, "cd: %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+static int builtin_exit(int argc, char** argv)
+{
+	fflush(stdout);
+	exit(argc > 1 ? atoi(argv[1]) : 0);
+}
+
+//print an argument of echo -e, false if \c stops the output
+static bool echo_escapes(const char* s)
+{
+	for(; *s; s++){
+		char c = *s;
+		int i;
+		if(c != '\\' || s[1] == 0){
+			putchar(c);
+			continue;
+		}
+		switch(*++s){
+		case 'a': c = '\a'; break;
+		case 'b': c = '\b'; break;
+		case 'c': return 0;
+		case 'e': c = 27; break;
+		case 'f': c = '\f'; break;
+		case 'n': c = '\n'; break;
+		case 'r': c = '\r'; break;
+		case 't': c = '\t'; break;
+		case 'v': c = '\v'; break;
+		case '\\': c = '\\'; break;
+		case '0':
+			c = 0;
+			for(i = 0; i < 3 && s[1] >= '0' && s[1] <= '7'; i++){
+				c = c * 8 + *++s - '0';
+			}
+			break;
+		default:
+			putchar('\\');
+			c = *s;
+		}
+		putchar(c);
+	}
+	return 1;
+}
+
+//options as in coreutils echo: any mix of -n, -e and -E
+static int builtin_echo(int argc, char** argv)
+{
+	bool is_newline = 1;
+	bool is_escapes = 0;
+	int i = 1;
+	for(; i < argc && argv[i][0] == '-' && argv[i][1]; i++){
+		const char* opt = argv[i] + 1;
+		if(strspn(opt, "neE") != strlen(opt)){
+			break;
+		}
+		for(; *opt; opt++){
+			if(*opt == 'n'){
+				is_newline = 0;
+			}else{
+				is_escapes = *opt == 'e';
+			}
+		}
+	}
+	for(; i < argc; i++){
+		if(is_escapes){
+			if(!echo_escapes(argv[i])){
+				return 0;
+			}
+		}else{
+			fputs(argv[i], stdout);
+		}
+		if(i + 1 < argc){
+			putchar(' ');
+		}
+	}
+	if(is_newline){
+		putchar('\n');
+	}
+	return 0;
+}
+
+static int builtin_pwd(int argc, char** argv)
+{
+	char path[PATH_MAX];
+	(void)argc;
+	(void)argv;
+	if(getcwd(path, sizeof(path)) == NULL){
+		perror("pwd");
+		return 1;
+	}
+	puts(path);
+	return 0;
+}
+
+//one line of stdin, the delimiter is not stored. A pipe is read by
+//bytes, so the rest of it is left to the next reader, a file is read
+//by blocks and the offset is moved back after the line. 0 at EOF
+static bool read_line(struct buffer* line)
+{
+	char block[READ_LINE_BLOCK];
+	bool is_seekable = lseek(0, 0, SEEK_CUR) != -1;
+	int size = is_seekable ? READ_LINE_BLOCK : 1;
+	char* nl;
+	int n;
+	while(1){
+		n = read(0, block, size);
+		if(n < 0 && errno == EINTR){
+			continue;
+		}
+		if(n <= 0){
+			return 0;
+		}
+		nl = (char*)memchr(block, '\n', n);
+		if(nl == NULL){
+			append_buffer(line, block, n);
+			continue;
+		}
+		append_buffer(line, block, nl - block);
+		if(nl + 1 < block + n){
+			lseek(0, nl + 1 - (block + n), SEEK_CUR);
+		}
+		return 1;
+	}
+}
+
+static bool is_blank(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+//read [-r] [name...]: the line is split on blanks, the last name
+//takes the rest. Without names it goes into REPLY. Without -r a
+//backslash keeps the next character and joins lines
+static int builtin_read(int argc, char** argv)
+{
+	struct buffer* raw = create_buffer(128);
+	struct buffer* text = create_buffer(128);
+	//true for the characters of text, escaped by a backslash
+	struct buffer* escaped = create_buffer(128);
+	bool is_raw = argc > 1 && strcmp(argv[1], "-r") == 0;
+	bool is_line;
+	bool is_joined;
+	int pos = 0;
+	int end;
+	int i;
+	do{
+		is_line = read_line(raw);
+		is_joined = 0;
+		for(i = 0; i < raw->pos; i++){
+			char c = raw->array[i];
+			bool is_escaped = !is_raw && c == '\\';
+			if(is_escaped && i + 1 == raw->pos){
+				is_joined = 1;
+				break;
+			}
+			if(is_escaped){
+				c = raw->array[++i];
+			}
+			insert_buffer(text, c);
+			insert_buffer(escaped, is_escaped);
+		}
+		raw->pos = 0;
+	}while(is_line && is_joined);
+	insert_buffer(text, 0);
+	if(argc == 1 + is_raw){
+		var_set("REPLY", text->array, 0);
+	}
+	for(i = 1 + is_raw; i < argc; i++){
+		for(; pos < escaped->pos && is_blank(text->array[pos]) &&
+			!escaped->array[pos]; pos++){
+		}
+		end = pos;
+		if(i + 1 < argc){
+			for(; end < escaped->pos && (!is_blank(text->array[end]) ||
+				escaped->array[end]); end++){
+			}
+		}else{
+			for(end = escaped->pos; end > pos &&
+				is_blank(text->array[end - 1]) && !escaped->array[end - 1];
+				end--){
+			}
+		}
+		text->array[end] = 0;
+		var_set(argv[i], text->array + pos, 0);
+		pos = end < escaped->pos ? end + 1 : end;
+	}
+	free_buffer(raw);
+	free_buffer(text);
+	free_buffer(escaped);
+	return is_line ? 0 : 1;
+}
+
+static int builtin_true(int argc, char** argv)
+{
+	(void)argc;
+	(void)argv;
+	return 0;
+}
+
+static int builtin_false(int argc, char** argv)
+{
+	(void)argc;
+	(void)argv;
+	return 1;
+}
+
+static const struct{
+	const char* name;
+	builtin_f func;
+} builtins[] = {
+	{"cat", builtin_cat},
+	{"cd", builtin_cd},
+	{"coproc", builtin_coproc},
+	{"echo", builtin_echo},
+	{"exit", builtin_exit},
+	{"export", builtin_export},
+	{"false", builtin_false},
+	{"fg", builtin_fg},
+	{"hash", builtin_hash},
+	{"history", builtin_history},
+	{"jobs", builtin_jobs},
+	{"parallel", builtin_parallel},
+	{"pwd", builtin_pwd},
+	{"read", builtin_read},
+	{"tee", builtin_tee},
+	{"true", builtin_true},
+	{"unset", builtin_unset},
+	{"wait", builtin_wait},
+};
+
+#define BUILTIN_COUNT (int)(sizeof(builtins) / sizeof(builtins[0]))
+
+builtin_f find_builtin(const char* name)
+{
+	int i;
+	for(i = 0; i < BUILTIN_COUNT; i++){
+		if(strcmp(builtins[i].name, name) == 0){
+			return builtins[i].func;
+		}
+	}
+	return NULL;
+}
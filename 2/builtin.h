@@ -0,0 +1,11 @@
+#ifndef BUILTIN_H
+#define BUILTIN_H
+
+//a builtin is run by the shell itself, stdin and stdout are already
+//redirected, the result is the exit code
+typedef int (*builtin_f)(int argc, char** argv);
+
+//NULL if the command is not a builtin
+builtin_f find_builtin(const char* name);
+
+#endif
@@ -2,6 +2,11 @@ import subprocess
 import argparse
 import sys
 import os
+import time
+import shutil
+import resource
+import tempfile
+import re
 
 parser = argparse.ArgumentParser(description='Tests for shell')
 parser.add_argument('-e', type=str, default='./a.out',
@@ -11,8 +16,154 @@ parser.add_argument('-t', action='store_true', default=False,
 		    help='run without checks')
 parser.add_argument('--max', type=int, choices=[15, 20, 25], default=15,
 		    help='max points number')
+parser.add_argument('--bench', action='store_true', default=False,
+		    help='measure throughput on generated scripts instead '\
+			 'of the tests')
+parser.add_argument('--scale', type=int, default=1,
+		    help='size multiplier of the benchmark scripts')
+parser.add_argument('--repeat', type=int, default=3,
+		    help='benchmark runs per script, the best one is taken')
+parser.add_argument('--against', type=str, default='bash,dash',
+		    help='comma separated baseline shells for the benchmark')
 args = parser.parse_args()
 
+# Benchmark mode. Each workload is a generated script fed to stdin of
+# the shell, the same way as the tests are. Commands per second are
+# counted by simple commands of the script. Forks are taken from the
+# system wide counter in /proc/stat, so the machine should be idle.
+# Exact fork and exec counts are taken from strace, when it is
+# installed. Parser time is the time of a run with -n, which only
+# parses the script.
+
+def gen_short(n):
+	lines = []
+	for i in range(n):
+		lines.append('echo short {}'.format(i))
+		lines.append('true')
+	return lines, 2 * n
+
+def gen_pipeline(n, width=8):
+	lines = []
+	for i in range(n):
+		lines.append('echo pipe {} | '.format(i) +
+			     ' | '.join(['cat'] * (width - 1)))
+	return lines, n * width
+
+def gen_chain(n, depth=32):
+	lines = []
+	chain = ['true', 'false', '/bin/true', 'echo x']
+	ops = [' && ', ' || ']
+	for i in range(n):
+		line = 'true'
+		for d in range(1, depth):
+			line += ops[d % 2] + chain[(i + d) % len(chain)]
+		lines.append(line)
+	return lines, n * depth
+
+def gen_background(n, burst=16):
+	lines = []
+	for i in range(n):
+		lines.extend(['/bin/true &'] * burst)
+		lines.append('wait')
+	return lines, n * (burst + 1)
+
+workloads = [
+	('short', gen_short, 2000),
+	('pipeline', gen_pipeline, 200),
+	('chain', gen_chain, 100),
+	('background', gen_background, 50),
+]
+
+def forks_total():
+	with open('/proc/stat') as f:
+		for line in f:
+			if line.startswith('processes '):
+				return int(line.split()[1])
+	return 0
+
+def run_shell(argv, script, timeout=120):
+	with open(script) as f:
+		forks = forks_total()
+		usage = resource.getrusage(resource.RUSAGE_CHILDREN)
+		start = time.monotonic()
+		subprocess.run(argv, stdin=f, stdout=subprocess.DEVNULL,
+			       stderr=subprocess.DEVNULL, timeout=timeout)
+		wall = time.monotonic() - start
+		forks = forks_total() - forks
+		end = resource.getrusage(resource.RUSAGE_CHILDREN)
+	cpu = end.ru_utime - usage.ru_utime + end.ru_stime - usage.ru_stime
+	# The shell itself is one of the forks.
+	return wall, cpu, forks - 1
+
+def best_run(argv, script):
+	runs = [run_shell(argv, script) for i in range(args.repeat)]
+	return min(runs, key=lambda r: r[0])
+
+syscall_re = re.compile(r'^\s*[\d.]+\s+[\d.]+\s+\d+\s+(\d+)'\
+			r'(?:\s+\d+)?\s+(\w+)\s*$')
+
+def strace_counts(argv, script):
+	trace = tempfile.NamedTemporaryFile(mode='r', suffix='.strace')
+	with open(script) as f:
+		subprocess.run(['strace', '-f', '-c', '-o', trace.name,
+				'-e', 'trace=fork,vfork,clone,clone3,execve'] +
+			       argv, stdin=f, stdout=subprocess.DEVNULL,
+			       stderr=subprocess.DEVNULL)
+	calls = {}
+	for line in trace:
+		m = syscall_re.match(line)
+		if m:
+			calls[m.group(2)] = int(m.group(1))
+	trace.close()
+	forks = sum(calls.get(c, 0) for c in
+		    ['fork', 'vfork', 'clone', 'clone3'])
+	# Minus exec of the shell itself.
+	return forks, calls.get('execve', 1) - 1
+
+def run_bench():
+	shells = [('shell', [os.path.abspath(args.e)])]
+	for name in args.against.split(','):
+		path = shutil.which(name) if name else None
+		if path:
+			shells.append((name, [path]))
+		elif name:
+			print('{} is not found, skipped'.format(name))
+	has_strace = shutil.which('strace') is not None
+	tmp = tempfile.mkdtemp(prefix='shell_bench')
+	print('{:<11} {:<6} {:>7} {:>8} {:>10} {:>8} {:>7} {:>7} {:>9}'.format(
+	      'workload', 'shell', 'cmds', 'wall s', 'cmds/s', 'cpu s',
+	      'forks', 'execs', 'parse ms'))
+	try:
+		for name, gen, n in workloads:
+			lines, commands = gen(n * args.scale)
+			script = os.path.join(tmp, name + '.sh')
+			with open(script, 'w') as f:
+				f.write('\n'.join(lines) + '\n')
+			for shell, argv in shells:
+				wall, cpu, forks = best_run(argv, script)
+				parse, _, _ = best_run(argv + ['-n'], script)
+				execs = '-'
+				if has_strace:
+					forks, execs = strace_counts(argv,
+								     script)
+				print('{:<11} {:<6} {:>7} {:>8.3f} {:>10.0f} '\
+				      '{:>8.3f} {:>7} {:>7} {:>9.1f}'.format(
+				      name, shell, commands, wall,
+				      commands / wall, cpu, forks, execs,
+				      parse * 1000))
+	except subprocess.TimeoutExpired as e:
+		print('{} is too slow: {}'.format(shell, e))
+		return -1
+	finally:
+		shutil.rmtree(tmp)
+	if not has_strace:
+		print('forks are from /proc/stat, install strace for '\
+		      'exact fork and exec counts')
+	return 0
+
+if args.bench:
+	sys.exit(run_bench())
+
 p = subprocess.Popen([args.e], shell=False, stdin=subprocess.PIPE,
 		     stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
 		     bufsize=0)
@@ -35,7 +186,10 @@ tests = [
 "echo 'truncate' > \"my file with whitespaces in name.txt\"",
 "cat \"my file with whitespaces in name.txt\"",
 "echo \"test 'test'' \\\\\" >> \"my file with whitespaces in name.txt\"",
-"cat \"my file with whitespaces in name.txt\""
+"cat \"my file with whitespaces in name.txt\"",
+"echo 'echo no shebang' > no_shebang.sh",
+"chmod +x no_shebang.sh",
+"./no_shebang.sh",
 ],
 [
 "# Comment",
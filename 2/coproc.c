@@ -0,0 +1,158 @@
+#define _GNU_SOURCE
+#include "coproc.h"
+#include "exec.h"
+#include "jobs.h"
+#include "vars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+//the shell ends of the pipes live until the coprocess is closed by
+//name. They are close-on-exec, commands reach them by /dev/fd paths
+struct coproc{
+	char* name;
+	//stdin of the coprocess
+	int in;
+	//stdout of the coprocess
+	int out;
+	struct coproc* next;
+};
+
+static struct coproc* first_coproc = NULL;
+
+static struct coproc** find_coproc(const char* name)
+{
+	struct coproc** p;
+	for(p = &first_coproc; *p; p = &(*p)->next){
+		if(strcmp((*p)->name, name) == 0){
+			break;
+		}
+	}
+	return p;
+}
+
+//NAME_suffix=value
+static void set_coproc_var(const char* name, const char* suffix,
+	const char* value)
+{
+	char var[strlen(name) + strlen(suffix) + 1];
+	sprintf(var, "%s%s", name, suffix);
+	if(value){
+		var_set(var, value, 0);
+	}else{
+		var_unset(var);
+	}
+}
+
+static void set_fd_var(const char* name, const char* suffix, int fd)
+{
+	char path[32];
+	snprintf(path, sizeof(path), "/dev/fd/%d", fd);
+	set_coproc_var(name, suffix, path);
+}
+
+//stdin is closed first, a worker usually exits on EOF then
+static void close_coproc(struct coproc** p)
+{
+	struct coproc* c = *p;
+	close(c->in);
+	close(c->out);
+	set_coproc_var(c->name, "_IN", NULL);
+	set_coproc_var(c->name, "_OUT", NULL);
+	set_coproc_var(c->name, "_PID", NULL);
+	*p = c->next;
+	free(c->name);
+	free(c);
+}
+
+static int start_coproc(const char* name, char** argv, int argc)
+{
+	struct node n;
+	struct coproc* c;
+	int to[2];
+	int from[2];
+	int exit_code;
+	char pid_str[16];
+	pid_t pid;
+	if(pipe2(to, O_CLOEXEC) != 0){
+		perror("pipe");
+		return 1;
+	}
+	if(pipe2(from, O_CLOEXEC) != 0){
+		perror("pipe");
+		close(to[0]);
+		close(to[1]);
+		return 1;
+	}
+	//the words are expanded already, the node is only for the start
+	//and for the text of the job
+	memset(&n, 0, sizeof(n));
+	n.type = NODE_COMMAND;
+	n.command.argc = argc;
+	n.command.argv = argv;
+	pid = start_stage(&n, to[0], from[1], to[1], &exit_code);
+	close(to[0]);
+	close(from[1]);
+	if(pid == -1){
+		close(to[1]);
+		close(from[0]);
+		return exit_code;
+	}
+	exit_code = 0;
+	job_add(&n, &pid, &exit_code, 1);
+	c = (struct coproc*)malloc(sizeof(struct coproc));
+	c->name = strdup(name);
+	c->in = to[1];
+	c->out = from[0];
+	c->next = first_coproc;
+	first_coproc = c;
+	set_fd_var(name, "_IN", c->in);
+	set_fd_var(name, "_OUT", c->out);
+	snprintf(pid_str, sizeof(pid_str), "%d", pid);
+	set_coproc_var(name, "_PID", pid_str);
+	return 0;
+}
+
+int builtin_coproc(int argc, char** argv)
+{
+	const char* name = "COPROC";
+	struct coproc** p;
+	bool is_close = 0;
+	int i = 1;
+	if(i < argc && strcmp(argv[i], "-c") == 0){
+		is_close = 1;
+		i++;
+		if(i < argc){
+			name = argv[i++];
+		}
+	}else if(i + 1 < argc && strcmp(argv[i], "-n") == 0){
+		name = argv[i + 1];
+		i += 2;
+	}
+	if((is_close && i != argc) || (!is_close && i == argc)){
+		fprintf(stderr, "coproc: usage: coproc [-n NAME] command [arg...]"
+			" or coproc -c [NAME]\n");
+		return 2;
+	}
+	if(!is_var_name(name, strlen(name))){
+		fprintf(stderr, "coproc: `%s': not a valid identifier\n", name);
+		return 1;
+	}
+	p = find_coproc(name);
+	if(is_close){
+		if(*p == NULL){
+			fprintf(stderr, "coproc: %s: no such coprocess\n", name);
+			return 1;
+		}
+		close_coproc(p);
+		return 0;
+	}
+	//a new one with the same name replaces the old one, as in bash
+	if(*p){
+		close_coproc(p);
+	}
+	return start_coproc(name, argv + i, argc - i);
+}
@@ -0,0 +1,13 @@
+#ifndef COPROC_H
+#define COPROC_H
+
+//coproc [-n NAME] command [arg...]: start a background job with two
+//pipes, the shell keeps the other ends. $NAME_IN is the path to write
+//into its stdin, $NAME_OUT to read its stdout, $NAME_PID is the pid.
+//NAME is COPROC by default. A warm worker serves many requests, as in
+//echo 2+2 > $NAME_IN; read x < $NAME_OUT
+//
+//coproc -c [NAME]: close the pipes, so the process gets EOF
+int builtin_coproc(int argc, char** argv);
+
+#endif
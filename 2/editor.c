@@ -0,0 +1,515 @@
+#define _GNU_SOURCE
+#include "editor.h"
+#include "history.h"
+#include "stream.h"
+#include "vars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#define EDITOR_LINE_SIZE 256
+
+#define KEY_CTRL(c) ((c) & 0x1f)
+#define KEY_ESCAPE 27
+#define KEY_BACKSPACE 127
+
+static void raw_mode(struct editor* ed)
+{
+	struct termios t = ed->cooked;
+	if(ed->is_raw){
+		return;
+	}
+	//Ctrl-C and others come as keys, the output is processed as usual
+	t.c_iflag &= ~(ICRNL | IXON | BRKINT | ISTRIP);
+	t.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+	t.c_cc[VMIN] = 1;
+	t.c_cc[VTIME] = 0;
+	tcsetattr(0, TCSADRAIN, &t);
+	ed->is_raw = 1;
+}
+
+static void cooked_mode(struct editor* ed)
+{
+	if(!ed->is_raw){
+		return;
+	}
+	tcsetattr(0, TCSADRAIN, &ed->cooked);
+	ed->is_raw = 0;
+}
+
+//the first byte of a character, not a continuation one of UTF-8
+static bool is_char_start(char c)
+{
+	return ((unsigned char)c & 0xc0) != 0x80;
+}
+
+static int columns(const char* s, int len)
+{
+	int n = 0;
+	int i;
+	for(i = 0; i < len; i++){
+		n += is_char_start(s[i]);
+	}
+	return n;
+}
+
+static int prev_char(const char* s, int pos)
+{
+	do{
+		pos--;
+	}while(pos > 0 && !is_char_start(s[pos]));
+	return pos;
+}
+
+static int next_char(const char* s, int len, int pos)
+{
+	do{
+		pos++;
+	}while(pos < len && !is_char_start(s[pos]));
+	return pos;
+}
+
+static int terminal_width()
+{
+	struct winsize ws;
+	if(ioctl(1, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0){
+		return 80;
+	}
+	return ws.ws_col;
+}
+
+//redraw the prompt, the text and the cursor with one write. A line
+//wider than the terminal is scrolled around the cursor
+static void refresh(struct editor* ed)
+{
+	struct buffer* out = create_buffer(EDITOR_LINE_SIZE);
+	const char* text = ed->line->array;
+	int len = ed->line->pos;
+	int cursor = ed->cursor;
+	const char* found;
+	char move[16];
+	int head;
+	int width;
+	int start = 0;
+	int end;
+	int col;
+	insert_buffer(out, '\r');
+	if(ed->is_search){
+		if(ed->is_search_failed){
+			append_buffer(out, "(failed ", 8);
+		}else{
+			insert_buffer(out, '(');
+		}
+		append_buffer(out, "reverse-i-search)`", 18);
+		append_buffer(out, ed->query->array, ed->query->pos);
+		append_buffer(out, "': ", 3);
+		if(ed->match >= 0){
+			text = history_entry(ed->match, &len);
+			found = (const char*)memmem(text, len, ed->query->array,
+				ed->query->pos);
+			cursor = found ? found - text : 0;
+		}
+	}else{
+		const char* prompt = var_get("PS1");
+		if(prompt == NULL){
+			prompt = "$ ";
+		}
+		append_buffer(out, prompt, strlen(prompt));
+	}
+	head = columns(out->array + 1, out->pos - 1);
+	width = terminal_width() - head - 1;
+	if(width < 1){
+		width = 1;
+	}
+	while(columns(text + start, cursor - start) > width){
+		start = next_char(text, len, start);
+	}
+	col = 0;
+	for(end = start; end < len; end++){
+		if(is_char_start(text[end])){
+			if(col == width){
+				break;
+			}
+			col++;
+		}
+	}
+	append_buffer(out, text + start, end - start);
+	append_buffer(out, "\x1b[K\r", 4);
+	col = head + columns(text + start, cursor - start);
+	if(col > 0){
+		append_buffer(out, move, snprintf(move, sizeof(move), "\x1b[%dC",
+			col));
+	}
+	write_all(1, out->array, out->pos);
+	free_buffer(out);
+}
+
+static void set_line(struct editor* ed, const char* text, int len)
+{
+	ed->line->pos = 0;
+	append_buffer(ed->line, text, len);
+	ed->cursor = len;
+}
+
+static void insert_text(struct editor* ed, const char* data, int n)
+{
+	struct buffer* b = ed->line;
+	reserve_buffer(b, n);
+	memmove(b->array + ed->cursor + n, b->array + ed->cursor,
+		b->pos - ed->cursor);
+	memcpy(b->array + ed->cursor, data, n);
+	b->pos += n;
+	ed->cursor += n;
+}
+
+static void delete_text(struct editor* ed, int from, int to)
+{
+	struct buffer* b = ed->line;
+	memmove(b->array + from, b->array + to, b->pos - to);
+	b->pos -= to - from;
+	ed->cursor = from;
+}
+
+static void clear_line(struct editor* ed)
+{
+	ed->line->pos = 0;
+	ed->cursor = 0;
+	ed->history_pos = -1;
+}
+
+//Enter: the line goes to history and to the shell, which runs it in
+//the usual terminal mode
+static void submit(struct editor* ed)
+{
+	struct buffer* b = ed->line;
+	ed->cursor = b->pos;
+	refresh(ed);
+	write_all(1, "\r\n", 2);
+	cooked_mode(ed);
+	history_add(b->array, b->pos);
+	insert_buffer(b, '\n');
+	ed->on_line(b->array, b->pos, ed->ctx);
+	fflush(stdout);
+	clear_line(ed);
+	raw_mode(ed);
+}
+
+//step -1 is an older entry, 1 is a newer one. The new line is kept
+//aside and is shown again after the newest entry
+static void show_history(struct editor* ed, int step)
+{
+	const char* entry;
+	int len;
+	int pos = ed->history_pos;
+	if(pos < 0){
+		if(step > 0){
+			return;
+		}
+		history_refresh();
+		pos = history_count();
+	}
+	pos += step;
+	if(pos < 0){
+		return;
+	}
+	if(ed->history_pos < 0){
+		ed->saved->pos = 0;
+		append_buffer(ed->saved, ed->line->array, ed->line->pos);
+	}
+	if(pos >= history_count()){
+		set_line(ed, ed->saved->array, ed->saved->pos);
+		ed->history_pos = -1;
+		return;
+	}
+	entry = history_entry(pos, &len);
+	set_line(ed, entry, len);
+	ed->history_pos = pos;
+}
+
+static void start_search(struct editor* ed)
+{
+	history_refresh();
+	ed->is_search = 1;
+	ed->is_search_failed = 0;
+	ed->query->pos = 0;
+	ed->match = -1;
+}
+
+//the shown match stays, when there is no older one
+static void search(struct editor* ed, int from)
+{
+	int found;
+	if(ed->query->pos == 0){
+		ed->match = -1;
+		ed->is_search_failed = 0;
+		return;
+	}
+	found = from < 0 ? -1 : history_search(ed->query->array,
+		ed->query->pos, from);
+	ed->is_search_failed = found < 0;
+	if(found >= 0){
+		ed->match = found;
+	}
+}
+
+//the match becomes the line, the cursor is at the query
+static void end_search(struct editor* ed, bool is_accept)
+{
+	const char* entry;
+	const char* found;
+	int len;
+	ed->is_search = 0;
+	if(!is_accept || ed->match < 0){
+		return;
+	}
+	entry = history_entry(ed->match, &len);
+	set_line(ed, entry, len);
+	found = (const char*)memmem(entry, len, ed->query->array,
+		ed->query->pos);
+	ed->cursor = found ? found - entry : len;
+	ed->history_pos = -1;
+}
+
+//false, if the key ends the search and is handled as usual
+static bool search_key(struct editor* ed, unsigned char c)
+{
+	switch(c){
+	case KEY_CTRL('R'):
+		if(ed->match >= 0){
+			search(ed, ed->match - 1);
+		}
+		return 1;
+	case KEY_CTRL('G'):
+	case KEY_CTRL('C'):
+		end_search(ed, 0);
+		return 1;
+	case KEY_CTRL('H'):
+	case KEY_BACKSPACE:
+		if(ed->query->pos > 0){
+			ed->query->pos = prev_char(ed->query->array, ed->query->pos);
+			search(ed, history_count() - 1);
+		}
+		return 1;
+	}
+	if(c >= ' '){
+		insert_buffer(ed->query, c);
+		search(ed, ed->match >= 0 ? ed->match : history_count() - 1);
+		return 1;
+	}
+	end_search(ed, 1);
+	return 0;
+}
+
+//ESC [ params final or ESC O final, the keys with other sequences
+//are ignored
+static void escape_key(struct editor* ed, char c)
+{
+	struct buffer* b = ed->line;
+	int param = 0;
+	int i;
+	ed->seq[ed->seq_len++] = c;
+	if(ed->seq_len == 2){
+		if(c != '[' && c != 'O'){
+			ed->seq_len = 0;
+		}
+		return;
+	}
+	if(c < 0x40 || c > 0x7e){
+		if(ed->seq_len == sizeof(ed->seq)){
+			ed->seq_len = 0;
+		}
+		return;
+	}
+	for(i = 2; i < ed->seq_len && ed->seq[i] >= '0' && ed->seq[i] <= '9';
+		i++){
+		param = param * 10 + ed->seq[i] - '0';
+	}
+	ed->seq_len = 0;
+	if(c == '~'){
+		c = param == 1 || param == 7 ? 'H' : param == 4 || param == 8 ?
+			'F' : param == 3 ? 'P' : 0;
+	}
+	switch(c){
+	case 'A':
+		show_history(ed, -1);
+		break;
+	case 'B':
+		show_history(ed, 1);
+		break;
+	case 'C':
+		if(ed->cursor < b->pos){
+			ed->cursor = next_char(b->array, b->pos, ed->cursor);
+		}
+		break;
+	case 'D':
+		if(ed->cursor > 0){
+			ed->cursor = prev_char(b->array, ed->cursor);
+		}
+		break;
+	case 'H':
+		ed->cursor = 0;
+		break;
+	case 'F':
+		ed->cursor = b->pos;
+		break;
+	case 'P':
+		if(ed->cursor < b->pos){
+			delete_text(ed, ed->cursor, next_char(b->array, b->pos,
+				ed->cursor));
+		}
+		break;
+	}
+}
+
+//-1 on Ctrl-D in an empty line
+static int edit_key(struct editor* ed, unsigned char c)
+{
+	struct buffer* b = ed->line;
+	int i;
+	switch(c){
+	case '\r':
+	case '\n':
+		submit(ed);
+		break;
+	case KEY_CTRL('A'):
+		ed->cursor = 0;
+		break;
+	case KEY_CTRL('E'):
+		ed->cursor = b->pos;
+		break;
+	case KEY_CTRL('B'):
+		if(ed->cursor > 0){
+			ed->cursor = prev_char(b->array, ed->cursor);
+		}
+		break;
+	case KEY_CTRL('F'):
+		if(ed->cursor < b->pos){
+			ed->cursor = next_char(b->array, b->pos, ed->cursor);
+		}
+		break;
+	case KEY_CTRL('H'):
+	case KEY_BACKSPACE:
+		if(ed->cursor > 0){
+			delete_text(ed, prev_char(b->array, ed->cursor), ed->cursor);
+		}
+		break;
+	case KEY_CTRL('D'):
+		if(b->pos == 0){
+			return -1;
+		}
+		if(ed->cursor < b->pos){
+			delete_text(ed, ed->cursor, next_char(b->array, b->pos,
+				ed->cursor));
+		}
+		break;
+	case KEY_CTRL('K'):
+		b->pos = ed->cursor;
+		break;
+	case KEY_CTRL('U'):
+		delete_text(ed, 0, ed->cursor);
+		break;
+	case KEY_CTRL('W'):
+		for(i = ed->cursor; i > 0 && b->array[i - 1] == ' '; i--){
+		}
+		for(; i > 0 && b->array[i - 1] != ' '; i--){
+		}
+		delete_text(ed, i, ed->cursor);
+		break;
+	case KEY_CTRL('L'):
+		write_all(1, "\x1b[H\x1b[2J", 7);
+		break;
+	case KEY_CTRL('P'):
+		show_history(ed, -1);
+		break;
+	case KEY_CTRL('N'):
+		show_history(ed, 1);
+		break;
+	case KEY_CTRL('R'):
+		start_search(ed);
+		break;
+	case KEY_CTRL('C'):
+		ed->cursor = b->pos;
+		refresh(ed);
+		write_all(1, "^C\r\n", 4);
+		clear_line(ed);
+		break;
+	case KEY_ESCAPE:
+		ed->seq[0] = c;
+		ed->seq_len = 1;
+		break;
+	default:
+		if(c >= ' '){
+			insert_text(ed, (const char*)&c, 1);
+		}
+	}
+	return 0;
+}
+
+void editor_create(struct editor* ed, edit_line_f on_line, void* ctx)
+{
+	ed->on_line = on_line;
+	ed->ctx = ctx;
+	ed->line = create_buffer(EDITOR_LINE_SIZE);
+	ed->saved = create_buffer(EDITOR_LINE_SIZE);
+	ed->query = create_buffer(32);
+	ed->cursor = 0;
+	ed->history_pos = -1;
+	ed->is_search = 0;
+	ed->is_search_failed = 0;
+	ed->match = -1;
+	ed->seq_len = 0;
+	ed->is_raw = 0;
+	tcgetattr(0, &ed->cooked);
+	history_open();
+	raw_mode(ed);
+	refresh(ed);
+}
+
+void editor_destroy(struct editor* ed)
+{
+	cooked_mode(ed);
+	history_close();
+	free_buffer(ed->line);
+	free_buffer(ed->saved);
+	free_buffer(ed->query);
+}
+
+//the line is drawn once for all the keys of one read, so a paste is
+//not redrawn for each byte
+int editor_feed(struct editor* ed, const char* data, int n)
+{
+	int i;
+	for(i = 0; i < n; i++){
+		unsigned char c = data[i];
+		if(ed->seq_len > 0){
+			escape_key(ed, c);
+			continue;
+		}
+		if(ed->is_search && search_key(ed, c)){
+			continue;
+		}
+		if(edit_key(ed, c) < 0){
+			write_all(1, "\r\n", 2);
+			return -1;
+		}
+	}
+	refresh(ed);
+	return 0;
+}
+
+void editor_pause(struct editor* ed)
+{
+	if(!ed->is_raw){
+		return;
+	}
+	write_all(1, "\r\x1b[K", 4);
+	cooked_mode(ed);
+}
+
+void editor_resume(struct editor* ed)
+{
+	raw_mode(ed);
+	refresh(ed);
+}
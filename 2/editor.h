@@ -0,0 +1,52 @@
+#ifndef EDITOR_H
+#define EDITOR_H
+
+#include <stdbool.h>
+#include <termios.h>
+#include "lexer.h"
+
+//line editor of the interactive shell. The terminal is in raw mode
+//only while a line is edited, commands run with the usual one. Keys
+//are as in bash: arrows, Home, End, Delete, Ctrl-A/E/B/F/K/U/W/L,
+//Up/Down and Ctrl-P/N walk the history, Ctrl-R searches it backwards
+
+//called with a complete line and its newline
+typedef void (*edit_line_f)(const char* line, int len, void* ctx);
+
+struct editor{
+	edit_line_f on_line;
+	void* ctx;
+	struct buffer* line;
+	int cursor;
+	//the new line, while the history is shown instead of it
+	struct buffer* saved;
+	//the shown history entry, -1 for the new line
+	int history_pos;
+	//Ctrl-R: the query and the newest entry, which contains it
+	bool is_search;
+	bool is_search_failed;
+	struct buffer* query;
+	int match;
+	//an escape sequence can come in several reads
+	char seq[16];
+	int seq_len;
+	struct termios cooked;
+	bool is_raw;
+};
+
+//opens the history and shows the prompt, $PS1 or "$ "
+void editor_create(struct editor* ed, edit_line_f on_line, void* ctx);
+
+void editor_destroy(struct editor* ed);
+
+//keys, read from the terminal. -1, when Ctrl-D is pressed in an
+//empty line
+int editor_feed(struct editor* ed, const char* data, int n);
+
+//hide the line and give the terminal back, when the shell is going
+//to print something in the middle of editing
+void editor_pause(struct editor* ed);
+
+void editor_resume(struct editor* ed);
+
+#endif
@@ -0,0 +1,623 @@
+#define _GNU_SOURCE
+#include "exec.h"
+#include "builtin.h"
+#include "pathhash.h"
+#include "jobs.h"
+#include "profile.h"
+#include "stream.h"
+#include "expand.h"
+#include "vars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+//here-document or string: a body, which fits into a pipe buffer, is
+//written into a pipe at once, there is no need in a writer process,
+//which would wait for the reader. The capacity is asked from the
+//pipe, it is one page for a user over the pipe limit, and the write
+//end is non-blocking, so a full pipe is an error. A bigger body or a
+//failed write goes into a memfd
+static int open_here(const char* str, bool is_newline)
+{
+	int len = strlen(str);
+	int size = len + is_newline;
+	int fd[2];
+	if(pipe2(fd, O_CLOEXEC) == 0){
+		if(fcntl(fd[1], F_GETPIPE_SZ) >= size &&
+			fcntl(fd[1], F_SETFL, O_WRONLY|O_NONBLOCK) == 0 &&
+			write_all(fd[1], str, len) == 0 &&
+			(!is_newline || write_all(fd[1], "\n", 1) == 0)){
+			close(fd[1]);
+			return fd[0];
+		}
+		close(fd[0]);
+		close(fd[1]);
+	}
+	fd[0] = memfd_create("here", MFD_CLOEXEC);
+	if(fd[0] == -1){
+		return -1;
+	}
+	if(write_all(fd[0], str, len) != 0 ||
+		(is_newline && write_all(fd[0], "\n", 1) != 0) ||
+		lseek(fd[0], 0, SEEK_SET) != 0){
+		close(fd[0]);
+		return -1;
+	}
+	return fd[0];
+}
+
+//open redirect files of a command in the shell, *in and *out are
+//-1 or the last opened files for stdin and stdout
+static int open_redirects(struct redirect* r, int* in, int* out)
+{
+	for(; r; r = r->next){
+		int fd;
+		int* to = out;
+		switch(r->type){
+		case REDIRECT_READ:
+			fd = open(r->path, O_RDONLY|O_CLOEXEC);
+			to = in;
+			break;
+		case REDIRECT_HEREDOC:
+		case REDIRECT_HERESTRING:
+			fd = open_here(r->path, r->type == REDIRECT_HERESTRING);
+			to = in;
+			break;
+		case REDIRECT_WRITE:
+			fd = open(r->path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,
+				S_IRWXU);
+			break;
+		default:
+			fd = open(r->path, O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC,
+				S_IRWXU);
+		}
+		if(fd == -1){
+			perror(to == out || r->type == REDIRECT_READ ? r->path :
+				"here-document");
+			return -1;
+		}
+		if(*to != -1){
+			close(*to);
+		}
+		*to = fd;
+	}
+	return 0;
+}
+
+static void close_files(int in, int out)
+{
+	if(in != -1){
+		close(in);
+	}
+	if(out != -1){
+		close(out);
+	}
+}
+
+//stdin and stdout of the shell, replaced by redirects for a while
+struct saved_fds{
+	int in;
+	int out;
+};
+
+//apply redirects to stdin and stdout of the shell itself, the old
+//ones are saved to be restored after
+static int redirect_shell(struct redirect* r, struct saved_fds* saved)
+{
+	int file_in = -1;
+	int file_out = -1;
+	saved->in = -1;
+	saved->out = -1;
+	if(open_redirects(r, &file_in, &file_out) != 0){
+		close_files(file_in, file_out);
+		return -1;
+	}
+	fflush(stdout);
+	if(file_in != -1){
+		saved->in = fcntl(0, F_DUPFD_CLOEXEC, 0);
+		dup2(file_in, 0);
+	}
+	if(file_out != -1){
+		saved->out = fcntl(1, F_DUPFD_CLOEXEC, 0);
+		dup2(file_out, 1);
+	}
+	close_files(file_in, file_out);
+	return 0;
+}
+
+static void restore_shell(struct saved_fds* saved)
+{
+	fflush(stdout);
+	if(saved->in != -1){
+		dup2(saved->in, 0);
+	}
+	if(saved->out != -1){
+		dup2(saved->out, 1);
+	}
+	close_files(saved->in, saved->out);
+}
+
+//a builtin alone runs in the shell, its redirects are applied to the
+//stdin and stdout of the shell for the time of the call
+static int execute_builtin(builtin_f f, struct command* cmd)
+{
+	struct saved_fds saved;
+	int exit_code;
+	if(redirect_shell(cmd->redirects, &saved) != 0){
+		return 1;
+	}
+	exit_code = f(cmd->argc, cmd->argv);
+	restore_shell(&saved);
+	return exit_code;
+}
+
+//a group with its redirects in the current process: the shell itself
+//for { list; }, a child for ( list )
+static int execute_compound(struct node* n)
+{
+	struct saved_fds saved;
+	int exit_code;
+	if(redirect_shell(n->group.redirects, &saved) != 0){
+		return 1;
+	}
+	exit_code = execute_line(n->group.body);
+	restore_shell(&saved);
+	return exit_code;
+}
+
+//fork a child with the given stdin and stdout, 0 is returned in the
+//child. The child does not exec, so the descriptors of the shell are
+//not closed by themselves, other_fd is the other end of the pipe
+static pid_t fork_stage(int in, int out, int other_fd)
+{
+	pid_t pid;
+	fflush(stdout);
+	if((pid = fork()) == 0){
+		jobs_child_reset();
+		if(other_fd != -1){
+			close(other_fd);
+		}
+		if(in != 0){
+			dup2(in, 0);
+			close(in);
+		}
+		if(out != 1){
+			dup2(out, 1);
+			close(out);
+		}
+		return 0;
+	}
+	if(pid == -1){
+		perror("fork");
+	}
+	return pid;
+}
+
+//a builtin inside a pipeline runs in a child, as any other stage
+static pid_t fork_builtin(builtin_f f, struct command* cmd, int in,
+	int out, int other_fd)
+{
+	pid_t pid = fork_stage(in, out, other_fd);
+	if(pid == 0){
+		exit(f(cmd->argc, cmd->argv));
+	}
+	return pid;
+}
+
+//a file without #! is a script for the system shell, it is run as
+//"/bin/sh path args...", the same as execvp() does
+static int spawn_script(pid_t* pid, const char* path, char** argv,
+	char** envp, posix_spawn_file_actions_t* actions)
+{
+	int argc;
+	int err;
+	char** sh_argv;
+	for(argc = 0; argv[argc]; argc++){
+	}
+	sh_argv = (char**)malloc((argc + 2) * sizeof(char*));
+	sh_argv[0] = (char*)"/bin/sh";
+	sh_argv[1] = (char*)path;
+	memcpy(sh_argv + 2, argv + 1, argc * sizeof(char*));
+	err = posix_spawn(pid, "/bin/sh", actions, NULL, sh_argv, envp);
+	free(sh_argv);
+	return err;
+}
+
+//the executable is taken from the path cache, so PATH is not walked
+//for each command. A cached file may have been removed since, then
+//it is looked up once again
+static int spawn_path(pid_t* pid, char** argv, char** envp,
+	posix_spawn_file_actions_t* actions)
+{
+	int err = ENOENT;
+	int attempt;
+	for(attempt = 0; attempt < 2 && err == ENOENT; attempt++){
+		const char* path = path_lookup(argv[0]);
+		if(path == NULL){
+			return ENOENT;
+		}
+		err = posix_spawn(pid, path, actions, NULL, argv, envp);
+		if(err == ENOEXEC){
+			err = spawn_script(pid, path, argv, envp, actions);
+		}
+		if(err == ENOENT){
+			path_forget(argv[0]);
+		}
+	}
+	return err;
+}
+
+//NAME=value words before a command are taken off it and go only into
+//its environment, which is returned malloc'ed then. Without a command
+//they set shell variables
+static char** take_assignments(struct command* cmd)
+{
+	char** envp = NULL;
+	int i;
+	if(cmd->assign_count == 0){
+		return NULL;
+	}
+	if(cmd->argc == cmd->assign_count){
+		for(i = 0; i < cmd->argc; i++){
+			var_assign(cmd->argv[i]);
+		}
+	}else{
+		envp = vars_environ_with(cmd->argv, cmd->assign_count);
+	}
+	cmd->argv += cmd->assign_count;
+	cmd->argc -= cmd->assign_count;
+	cmd->assign_count = 0;
+	return envp;
+}
+
+//start an expanded command with the given stdin and stdout, return
+//its pid or -1, if there is no process to wait for, then *exit_code
+//is set. envp is NULL for the usual environment
+//
+//posix_spawn() does not copy the page tables of the shell, the only
+//work in the child is dup2() of the descriptors and exec. All other
+//descriptors of the shell are close-on-exec
+static pid_t start_command(struct command* cmd, char** envp, int in,
+	int out, int other_fd, int* exit_code)
+{
+	posix_spawn_file_actions_t actions;
+	builtin_f builtin;
+	int file_in = -1;
+	int file_out = -1;
+	pid_t pid = -1;
+	int err;
+	*exit_code = 0;
+	if(open_redirects(cmd->redirects, &file_in, &file_out) != 0){
+		*exit_code = 1;
+		goto close_files;
+	}
+	if(cmd->argc == 0){
+		goto close_files;
+	}
+	if(file_in != -1){
+		in = file_in;
+	}
+	if(file_out != -1){
+		out = file_out;
+	}
+	builtin = find_builtin(cmd->argv[0]);
+	if(builtin){
+		pid = fork_builtin(builtin, cmd, in, out, other_fd);
+		*exit_code = 1;
+		goto close_files;
+	}
+	posix_spawn_file_actions_init(&actions);
+	if(in != 0){
+		posix_spawn_file_actions_adddup2(&actions, in, 0);
+	}
+	if(out != 1){
+		posix_spawn_file_actions_adddup2(&actions, out, 1);
+	}
+	err = spawn_path(&pid, cmd->argv, envp ? envp : vars_environ(),
+		&actions);
+	posix_spawn_file_actions_destroy(&actions);
+	if(err == ENOENT && !strchr(cmd->argv[0], '/')){
+		fprintf(stderr, "%s: command not found\n", cmd->argv[0]);
+	}else if(err != 0){
+		fprintf(stderr, "%s: %s\n", cmd->argv[0], strerror(err));
+	}
+	if(err != 0){
+		pid = -1;
+		*exit_code = 127;
+	}
+close_files:
+	close_files(file_in, file_out);
+	return pid;
+}
+
+//a stage of a pipeline: a command is expanded right before its start,
+//a group runs in a child
+pid_t start_stage(struct node* n, int in, int out, int other_fd,
+	int* exit_code)
+{
+	struct command cmd;
+	struct command words;
+	char** envp;
+	pid_t pid;
+	*exit_code = 1;
+	if(n->type != NODE_COMMAND){
+		if((pid = fork_stage(in, out, other_fd)) == 0){
+			exit(execute_compound(n));
+		}
+		return pid;
+	}
+	if(expand_command(&n->command, &cmd) != 0){
+		return -1;
+	}
+	words = cmd;
+	envp = take_assignments(&words);
+	pid = start_command(&words, envp, in, out, other_fd, exit_code);
+	free(envp);
+	free_command(&n->command, &cmd);
+	return pid;
+}
+
+static bool has_input_redirect(struct command* cmd)
+{
+	struct redirect* r;
+	for(r = cmd->redirects; r; r = r->next){
+		if(r->type == REDIRECT_READ || r->type == REDIRECT_HEREDOC ||
+			r->type == REDIRECT_HERESTRING){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//"cat file | cmd" is run as "cmd < file": the file is given to cmd
+//directly instead of a copy through a pipe. -1, if the pipeline is
+//not of this form or the file can not be opened - then cat reports
+static int open_cat_file(struct node* cat, struct node* next)
+{
+	struct command* cmd = &cat->command;
+	struct stat st;
+	int fd;
+	if(cat->type != NODE_COMMAND || next->type != NODE_COMMAND ||
+		cmd->expansions ||
+		cmd->argc != 2 || strcmp(cmd->argv[0], "cat") != 0 ||
+		cmd->argv[1][0] == '-' || cmd->redirects ||
+		has_input_redirect(&next->command)){
+		return -1;
+	}
+	//only a regular file: a fifo or a tty would block the shell in
+	//open or hand the reads to cmd, so they are left to cat. The open
+	//does not wait for a writer, the flag is cleared after the check
+	fd = open(cmd->argv[1], O_RDONLY|O_CLOEXEC|O_NONBLOCK);
+	if(fd != -1 && (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+		fcntl(fd, F_SETFL, O_RDONLY) != 0)){
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+//stage i reads from in, writes into a new pipe, if it is not the
+//last one, the read end of the pipe becomes input of the next one.
+//A stage, which is not started, has pid -1 and a known exit code
+static void start_pipeline(struct node** stages, int count, pid_t* pids,
+	int* exit_codes)
+{
+	int in = -1;
+	int i = 0;
+	if(count > 1 && (in = open_cat_file(stages[0], stages[1])) != -1){
+		pids[0] = -1;
+		exit_codes[0] = 0;
+		i = 1;
+	}
+	for(; i < count; i++){
+		int fd[2] = {-1, -1};
+		if(i + 1 < count && pipe2(fd, O_CLOEXEC) != 0){
+			perror("pipe");
+			break;
+		}
+		pids[i] = start_stage(stages[i], in == -1 ? 0 : in,
+			fd[1] == -1 ? 1 : fd[1], fd[0], &exit_codes[i]);
+		if(in != -1){
+			close(in);
+		}
+		if(fd[1] != -1){
+			close(fd[1]);
+		}
+		in = fd[0];
+	}
+	for(; i < count; i++){
+		pids[i] = -1;
+		exit_codes[i] = 1;
+	}
+}
+
+//a builtin or a brace group alone runs in the shell itself
+static int execute_in_shell(builtin_f builtin, struct command* cmd,
+	struct node* stage)
+{
+	return builtin ? execute_builtin(builtin, cmd) :
+		execute_compound(stage);
+}
+
+//only pids of the pipeline are waited for, background jobs are left
+//to the SIGCHLD handler. Resource usage of the stages comes with
+//wait4() for free, it is reported only if it is asked for
+static int run_pipeline(struct node* n, struct node** stages, int count)
+{
+	pid_t pids[count];
+	int exit_codes[count];
+	struct stage_usage usages[count];
+	struct timespec start;
+	struct command cmd;
+	struct command words;
+	char** envp = NULL;
+	builtin_f builtin = NULL;
+	bool is_expanded = 0;
+	bool is_profiled = profile_is_wanted(n);
+	int i;
+	int s;
+	if(is_profiled){
+		clock_gettime(CLOCK_MONOTONIC, &start);
+	}
+	//a single command is expanded here, as it can become a builtin
+	if(count == 1 && stages[0]->type == NODE_COMMAND){
+		if(expand_command(&stages[0]->command, &cmd) != 0){
+			return 1;
+		}
+		is_expanded = 1;
+		words = cmd;
+		envp = take_assignments(&words);
+		if(words.argc > 0){
+			builtin = find_builtin(words.argv[0]);
+		}
+	}
+	if(builtin || (count == 1 && stages[0]->type == NODE_GROUP)){
+		struct rusage before;
+		if(!is_profiled){
+			s = execute_in_shell(builtin, &words, stages[0]);
+		}else{
+			getrusage(RUSAGE_SELF, &before);
+			usages[0].pid = getpid();
+			s = usages[0].exit_code = execute_in_shell(builtin, &words,
+				stages[0]);
+			rusage_diff(&before, &usages[0].ru);
+			profile_report(n, stages, usages, 1, &start);
+		}
+		if(is_expanded){
+			free(envp);
+			free_command(&stages[0]->command, &cmd);
+		}
+		return s;
+	}
+	if(is_expanded){
+		pids[0] = start_command(&words, envp, 0, 1, -1, &exit_codes[0]);
+		free(envp);
+		free_command(&stages[0]->command, &cmd);
+	}else{
+		start_pipeline(stages, count, pids, exit_codes);
+	}
+	for(i = 0; i < count; i++){
+		usages[i].pid = pids[i];
+		memset(&usages[i].ru, 0, sizeof(usages[i].ru));
+		if(pids[i] != -1 && wait4(pids[i], &s, 0, &usages[i].ru) ==
+			pids[i]){
+			exit_codes[i] = exit_code_of(s);
+		}
+		usages[i].exit_code = exit_codes[i];
+	}
+	if(is_profiled){
+		profile_report(n, stages, usages, count, &start);
+	}
+	return exit_codes[count - 1];
+}
+
+//each pipeline sets $?
+static int execute_pipeline(struct node* n, struct node** stages,
+	int count)
+{
+	int exit_code = run_pipeline(n, stages, count);
+	vars_set_status(exit_code);
+	return exit_code;
+}
+
+int execute_node(struct node* n)
+{
+	int exit_code;
+	int pid;
+	switch(n->type){
+	case NODE_COMMAND:
+		return execute_pipeline(n, &n, 1);
+	case NODE_PIPELINE:
+		return execute_pipeline(n, n->pipeline.stages, n->pipeline.count);
+	case NODE_SUBSHELL:
+	case NODE_GROUP:
+		return execute_pipeline(n, &n, 1);
+	case NODE_AND:
+	case NODE_OR:
+		//the chain is right-deep, the operator of each link is between
+		//its left and the first item of its right, so a long chain is
+		//run in a loop
+		exit_code = execute_node(n->pair.left);
+		while(1){
+			struct node* next = n->pair.right;
+			bool is_chain = next->type == NODE_AND || next->type == NODE_OR;
+			if((n->type == NODE_AND) == (exit_code == 0)){
+				exit_code = execute_node(is_chain ? next->pair.left : next);
+			}
+			if(!is_chain){
+				return exit_code;
+			}
+			n = next;
+		}
+	case NODE_SEQUENCE:
+		for(; n->type == NODE_SEQUENCE; n = n->pair.right){
+			execute_node(n->pair.left);
+			if(n->pair.right == NULL){
+				return 0;
+			}
+		}
+		return execute_node(n);
+	case NODE_BACKGROUND:
+		fflush(stdout);
+		if((pid = fork()) == 0){
+			jobs_child_reset();
+			exit(execute_node(n->child));
+		}
+		return pid == -1 ? 1 : 0;
+	}
+	return 1;
+}
+
+//foreground items are run by the shell itself. Stages of a background
+//pipeline are started and left running, other background items need
+//a child to go on while the shell reads next lines
+static int execute_item(struct node* n)
+{
+	pid_t pid;
+	int exit_code = 0;
+	if(n->type != NODE_BACKGROUND){
+		return execute_node(n);
+	}
+	n = n->child;
+	if(n->type == NODE_COMMAND || n->type == NODE_PIPELINE ||
+		n->type == NODE_SUBSHELL || n->type == NODE_GROUP){
+		struct node** stages = n->type == NODE_PIPELINE ?
+			n->pipeline.stages : &n;
+		int count = n->type == NODE_PIPELINE ? n->pipeline.count : 1;
+		pid_t pids[count];
+		int exit_codes[count];
+		start_pipeline(stages, count, pids, exit_codes);
+		job_add(n, pids, exit_codes, count);
+		vars_set_status(0);
+		return 0;
+	}
+	fflush(stdout);
+	if((pid = fork()) == 0){
+		jobs_child_reset();
+		exit(execute_node(n));
+	}
+	if(pid == -1){
+		perror("fork");
+		exit_code = 1;
+	}
+	job_add(n, &pid, &exit_code, 1);
+	vars_set_status(0);
+	return 0;
+}
+
+int execute_line(struct node* root)
+{
+	while(root->type == NODE_SEQUENCE){
+		execute_item(root->pair.left);
+		root = root->pair.right;
+	}
+	return execute_item(root);
+}
@@ -0,0 +1,22 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+#include <sys/types.h>
+#include "parser.h"
+
+//execute a node in the current process, return its exit code
+int execute_node(struct node* n);
+
+//start a command or a group with the given stdin and stdout and leave
+//it running, as a stage of a background pipeline. other_fd is closed
+//in a child, which does not exec. -1, if there is no process, then
+//*exit_code is set
+pid_t start_stage(struct node* n, int in, int out, int other_fd,
+	int* exit_code);
+
+//execute a parsed command line: foreground part is waited for,
+//background part is only started. The result is the exit code of
+//the last item
+int execute_line(struct node* root);
+
+#endif
@@ -0,0 +1,379 @@
+#define _GNU_SOURCE
+#include "expand.h"
+#include "exec.h"
+#include "jobs.h"
+#include "vars.h"
+#include "pathglob.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#define OUTPUT_BLOCK_SIZE 4096
+
+struct fields{
+	//NULL-terminated, when there is at least one field
+	char** argv;
+	int argc;
+	int capacity;
+};
+
+//the command of a substitution is parsed and executed line by line
+//in the child, as the shell does with its input
+struct subst_shell{
+	struct arena arena;
+	int exit_code;
+};
+
+static void subst_line(struct token* tokens, void* ctx)
+{
+	struct subst_shell* sh = (struct subst_shell*)ctx;
+	const char* error;
+	struct node* root = parse_line(tokens, &sh->arena, &error);
+	if(root){
+		sh->exit_code = execute_line(root);
+	}else if(error){
+		fprintf(stderr, "%s\n", error);
+		sh->exit_code = 2;
+	}
+	arena_reset(&sh->arena);
+	glob_cache_clear();
+}
+
+static int run_text(const char* text)
+{
+	struct subst_shell sh;
+	struct lexer lx;
+	const char* error;
+	arena_create(&sh.arena);
+	sh.exit_code = 0;
+	lexer_create(&lx, &sh.arena, subst_line, &sh);
+	lexer_feed(&lx, text, strlen(text));
+	error = lexer_finish(&lx);
+	if(error){
+		fprintf(stderr, "%s\n", error);
+		sh.exit_code = 2;
+	}
+	lexer_destroy(&lx);
+	arena_destroy(&sh.arena);
+	return sh.exit_code;
+}
+
+//stdout of the child goes into a pipe, the shell reads it into a
+//growing buffer until EOF and only then waits for the child, so a
+//big output can not block both. Trailing newlines are removed
+static struct buffer* command_output(const char* text)
+{
+	struct buffer* out;
+	pid_t pid;
+	int fd[2];
+	int status;
+	int n;
+	if(pipe2(fd, O_CLOEXEC) != 0){
+		perror("pipe");
+		return NULL;
+	}
+	fflush(stdout);
+	if((pid = fork()) == 0){
+		jobs_child_reset();
+		dup2(fd[1], 1);
+		close(fd[0]);
+		close(fd[1]);
+		exit(run_text(text));
+	}
+	close(fd[1]);
+	if(pid == -1){
+		perror("fork");
+		close(fd[0]);
+		return NULL;
+	}
+	out = create_buffer(OUTPUT_BLOCK_SIZE);
+	while(1){
+		reserve_buffer(out, OUTPUT_BLOCK_SIZE);
+		n = read(fd[0], out->array + out->pos, out->len - out->pos);
+		if(n > 0){
+			out->pos += n;
+		}else if(n == 0 || errno != EINTR){
+			break;
+		}
+	}
+	close(fd[0]);
+	while(waitpid(pid, &status, 0) == -1 && errno == EINTR){
+	}
+	while(out->pos > 0 && out->array[out->pos - 1] == '\n'){
+		out->pos--;
+	}
+	return out;
+}
+
+//$?, $$ and positional parameters
+static bool is_special(const char* name)
+{
+	return name[0] && name[1] == 0 && (name[0] == '?' || name[0] == '$' ||
+		(name[0] >= '0' && name[0] <= '9'));
+}
+
+//output of the command or value of the variable, NULL on an error
+static struct buffer* expansion_result(struct expansion* e)
+{
+	struct buffer* out;
+	const char* value;
+	int len;
+	if(e->type == EXPANSION_COMMAND){
+		return command_output(e->text);
+	}
+	if(!is_var_name(e->text, strlen(e->text)) && !is_special(e->text)){
+		fprintf(stderr, "${%s}: bad substitution\n", e->text);
+		return NULL;
+	}
+	value = var_get(e->text);
+	len = value ? strlen(value) : 0;
+	out = create_buffer(len + 1);
+	append_buffer(out, value, len);
+	return out;
+}
+
+static void add_string(struct fields* f, char* str)
+{
+	if(f->argc + 2 > f->capacity){
+		f->capacity = f->capacity ? f->capacity * 2 : 8;
+		f->argv = (char**)realloc(f->argv, f->capacity * sizeof(char*));
+	}
+	f->argv[f->argc++] = str;
+	f->argv[f->argc] = NULL;
+}
+
+static void free_fields(struct fields* f)
+{
+	int i;
+	for(i = 0; i < f->argc; i++){
+		free(f->argv[i]);
+	}
+	free(f->argv);
+}
+
+static bool is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n';
+}
+
+//a field being built. pattern is the same text for pathname expansion,
+//where only unquoted *, ?, [ and ] are active, others are escaped
+struct field{
+	struct buffer* text;
+	struct buffer* pattern;
+	bool is_started;
+	bool is_glob;
+};
+
+static void append_literal(struct field* fd, const char* str, int len)
+{
+	int i;
+	append_buffer(fd->text, str, len);
+	for(i = 0; i < len; i++){
+		if(strchr("*?[]\\", str[i])){
+			insert_buffer(fd->pattern, '\\');
+		}
+		insert_buffer(fd->pattern, str[i]);
+	}
+	fd->is_started = 1;
+}
+
+static void append_active(struct field* fd, char c)
+{
+	insert_buffer(fd->text, c);
+	insert_buffer(fd->pattern, c);
+	fd->is_glob |= c == '*' || c == '?' || c == '[';
+	fd->is_started = 1;
+}
+
+//a field with active characters becomes the matching paths, it stays
+//as is, if there are none
+static void end_field(struct fields* f, struct field* fd)
+{
+	char** paths = NULL;
+	int count = 0;
+	int i;
+	if(fd->is_glob){
+		insert_buffer(fd->pattern, 0);
+		paths = glob_paths(fd->pattern->array, &count);
+	}
+	for(i = 0; i < count; i++){
+		add_string(f, paths[i]);
+	}
+	free(paths);
+	if(count == 0){
+		add_string(f, strndup(fd->text->array, fd->text->pos));
+	}
+	fd->text->pos = 0;
+	fd->pattern->pos = 0;
+	fd->is_started = 0;
+	fd->is_glob = 0;
+}
+
+//literal parts of the word are never split, so "a b"$(cmd) keeps the
+//space. A word, which is only an empty unquoted result, disappears.
+//Values of assignments are neither split nor matched against paths
+static int expand_word(const char* word, struct expansion* e,
+	struct fields* f, bool is_split)
+{
+	struct field fd;
+	int pos = 0;
+	int i;
+	fd.text = create_buffer(64);
+	fd.pattern = create_buffer(64);
+	fd.is_started = e == NULL;
+	fd.is_glob = 0;
+	for(; e; e = e->next){
+		struct buffer* out;
+		if(e->offset > pos){
+			append_literal(&fd, word + pos, e->offset - pos);
+			pos = e->offset;
+		}
+		//the unquoted glob character itself is in the word
+		if(e->type == EXPANSION_GLOB){
+			if(is_split){
+				append_active(&fd, word[pos]);
+			}else{
+				append_literal(&fd, word + pos, 1);
+			}
+			pos++;
+			continue;
+		}
+		out = expansion_result(e);
+		if(out == NULL){
+			free_buffer(fd.text);
+			free_buffer(fd.pattern);
+			return -1;
+		}
+		if(e->is_quoted || !is_split){
+			append_literal(&fd, out->array, out->pos);
+		}
+		for(i = 0; !e->is_quoted && is_split && i < out->pos; i++){
+			if(!is_blank(out->array[i])){
+				append_active(&fd, out->array[i]);
+			}else if(fd.is_started){
+				end_field(f, &fd);
+			}
+		}
+		free_buffer(out);
+	}
+	if(word[pos]){
+		append_literal(&fd, word + pos, strlen(word + pos));
+	}
+	if(fd.is_started){
+		end_field(f, &fd);
+	}
+	free_buffer(fd.text);
+	free_buffer(fd.pattern);
+	return 0;
+}
+
+//a redirect needs exactly one file name
+static char* expand_path(struct redirect* r)
+{
+	struct fields f = {NULL, 0, 0};
+	struct buffer* source;
+	char* path;
+	if(expand_word(r->path, r->expansions, &f, 1) != 0){
+		free_fields(&f);
+		return NULL;
+	}
+	if(f.argc == 1){
+		path = f.argv[0];
+		free(f.argv);
+		return path;
+	}
+	source = create_buffer(64);
+	format_word(r->path, r->expansions, source);
+	fprintf(stderr, "%.*s: ambiguous redirect\n", source->pos,
+		source->array);
+	free_buffer(source);
+	free_fields(&f);
+	return NULL;
+}
+
+static bool has_path_expansions(struct command* cmd)
+{
+	struct redirect* r;
+	for(r = cmd->redirects; r; r = r->next){
+		if(r->expansions){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int expand_command(struct command* cmd, struct command* out)
+{
+	struct fields f = {NULL, 0, 0};
+	struct redirect* r;
+	struct redirect** last;
+	int res = 0;
+	int i;
+	*out = *cmd;
+	out->expansions = NULL;
+	if(cmd->expansions){
+		for(i = 0; i < cmd->argc && res == 0; i++){
+			res = expand_word(cmd->argv[i], cmd->expansions[i], &f,
+				i >= cmd->assign_count);
+		}
+		if(f.argv == NULL){
+			f.argv = (char**)calloc(1, sizeof(char*));
+		}
+		out->argc = f.argc;
+		out->argv = f.argv;
+	}
+	if(res == 0 && has_path_expansions(cmd)){
+		//the list is copied, so only expanded paths are allocated
+		last = &out->redirects;
+		for(r = cmd->redirects; r; r = r->next){
+			struct redirect* copy = (struct redirect*)malloc(
+				sizeof(struct redirect));
+			*copy = *r;
+			copy->expansions = NULL;
+			copy->next = NULL;
+			*last = copy;
+			last = &copy->next;
+			if(r->expansions && (copy->path = expand_path(r)) == NULL){
+				res = -1;
+				break;
+			}
+		}
+	}
+	if(res != 0){
+		free_command(cmd, out);
+	}
+	return res;
+}
+
+void free_command(struct command* cmd, struct command* out)
+{
+	struct redirect* r;
+	struct redirect* copy;
+	struct redirect* next;
+	int i;
+	if(cmd->expansions){
+		for(i = 0; i < out->argc; i++){
+			free(out->argv[i]);
+		}
+		free(out->argv);
+		out->argv = NULL;
+		out->argc = 0;
+	}
+	if(out->redirects == cmd->redirects){
+		return;
+	}
+	for(r = cmd->redirects, copy = out->redirects; copy;
+		r = r->next, copy = next){
+		next = copy->next;
+		if(r->expansions){
+			free(copy->path);
+		}
+		free(copy);
+	}
+	out->redirects = cmd->redirects;
+}
@@ -0,0 +1,16 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include "parser.h"
+
+//expand words of a command: $(...) is replaced with the output of the
+//command, $NAME with the value, an unquoted result is split into
+//fields on blanks and newlines. Fields with unquoted *, ? or [...]
+//become the matching paths. A command without expansions is copied
+//as is. -1, if an expansion fails, it is reported
+int expand_command(struct command* cmd, struct command* out);
+
+//free what expand_command has allocated for out
+void free_command(struct command* cmd, struct command* out);
+
+#endif
@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+#include "history.h"
+#include "stream.h"
+#include "vars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define HISTORY_MAP_MIN 65536
+#define HISTORY_START_COUNT 1024
+
+static int history_fd = -1;
+//the mapping is bigger than the file, so appends of the file need a
+//new mapping only sometimes. Only the bytes of the file are touched,
+//the rest would give SIGBUS
+static char* map = NULL;
+static size_t map_len = 0;
+static size_t file_size = 0;
+//offsets of the line starts, starts[count] is the end of the last
+//complete line. An incomplete one, which is being written, is not an
+//entry yet
+static size_t* starts = NULL;
+static int count = 0;
+static int capacity = 0;
+
+int history_open()
+{
+	const char* path = var_get("HISTFILE");
+	const char* home = var_get("HOME");
+	char* home_path = NULL;
+	if(path == NULL || *path == 0){
+		if(home == NULL){
+			return -1;
+		}
+		home_path = (char*)malloc(strlen(home) + 16);
+		sprintf(home_path, "%s/.shell_history", home);
+		path = home_path;
+	}
+	history_fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+		0600);
+	free(home_path);
+	if(history_fd < 0){
+		return -1;
+	}
+	capacity = HISTORY_START_COUNT;
+	starts = (size_t*)malloc((capacity + 1) * sizeof(size_t));
+	starts[0] = 0;
+	count = 0;
+	history_refresh();
+	return 0;
+}
+
+static void unmap()
+{
+	if(map){
+		munmap(map, map_len);
+	}
+	map = NULL;
+	map_len = 0;
+	file_size = 0;
+	count = 0;
+	starts[0] = 0;
+}
+
+void history_close()
+{
+	if(history_fd < 0){
+		return;
+	}
+	unmap();
+	close(history_fd);
+	history_fd = -1;
+	free(starts);
+	starts = NULL;
+}
+
+//index the lines, which have been completed since the last time
+static void index_lines()
+{
+	const char* p = map + starts[count];
+	const char* end = map + file_size;
+	const char* nl;
+	if(file_size == 0){
+		return;
+	}
+	while((nl = (const char*)memchr(p, '\n', end - p)) != NULL){
+		if(count == capacity){
+			capacity *= 2;
+			starts = (size_t*)realloc(starts,
+				(capacity + 1) * sizeof(size_t));
+		}
+		p = nl + 1;
+		starts[++count] = p - map;
+	}
+}
+
+void history_refresh()
+{
+	struct stat st;
+	size_t len;
+	if(history_fd < 0 || fstat(history_fd, &st) != 0 ||
+		(size_t)st.st_size == file_size){
+		return;
+	}
+	//truncated by someone, everything is indexed again
+	if((size_t)st.st_size < file_size){
+		unmap();
+	}
+	if((size_t)st.st_size > map_len){
+		for(len = map_len ? map_len : HISTORY_MAP_MIN;
+			len < (size_t)st.st_size; len *= 2){
+		}
+		if(map){
+			munmap(map, map_len);
+		}
+		map = (char*)mmap(NULL, len, PROT_READ, MAP_SHARED, history_fd, 0);
+		if(map == MAP_FAILED){
+			map = NULL;
+			unmap();
+			return;
+		}
+		map_len = len;
+	}
+	file_size = st.st_size;
+	index_lines();
+}
+
+int history_count()
+{
+	return count;
+}
+
+const char* history_entry(int i, int* len)
+{
+	*len = starts[i + 1] - starts[i] - 1;
+	return map + starts[i];
+}
+
+void history_add(const char* line, int len)
+{
+	const char* last;
+	int last_len;
+	char* data;
+	int n = 0;
+	int i;
+	for(i = 0; i < len && (line[i] == ' ' || line[i] == '\t'); i++){
+	}
+	if(i == len || history_fd < 0){
+		return;
+	}
+	//the index is brought up to date under the lock, so the check of
+	//the last entry and the torn line below see the whole file
+	flock(history_fd, LOCK_EX);
+	history_refresh();
+	if(count > 0){
+		last = history_entry(count - 1, &last_len);
+		if(last_len == len && memcmp(last, line, len) == 0){
+			flock(history_fd, LOCK_UN);
+			return;
+		}
+	}
+	data = (char*)malloc(len + 2);
+	//a shell has died in the middle of a line, it is finished here
+	if(file_size > starts[count]){
+		data[n++] = '\n';
+	}
+	memcpy(data + n, line, len);
+	n += len;
+	data[n++] = '\n';
+	write_all(history_fd, data, n);
+	flock(history_fd, LOCK_UN);
+	free(data);
+	history_refresh();
+}
+
+//the entry, which contains the byte at offset
+static int entry_of(size_t offset)
+{
+	int left = 0;
+	int right = count - 1;
+	while(left < right){
+		int mid = (left + right + 1) / 2;
+		if(starts[mid] <= offset){
+			left = mid;
+		}else{
+			right = mid - 1;
+		}
+	}
+	return left;
+}
+
+int history_search(const char* query, int len, int from)
+{
+	size_t end;
+	const char* p;
+	if(from >= count){
+		from = count - 1;
+	}
+	if(from < 0 || len == 0){
+		return from;
+	}
+	//the mapping is searched backwards as one string: the query has no
+	//newlines, so a match never spans two entries
+	end = starts[from + 1];
+	while(end >= (size_t)len && (p = (const char*)memrchr(map, query[0],
+		end - len + 1)) != NULL){
+		if(memcmp(p, query, len) == 0){
+			return entry_of(p - map);
+		}
+		end = p - map + len - 1;
+	}
+	return -1;
+}
+
+int builtin_history(int argc, char** argv)
+{
+	const char* entry;
+	int len;
+	int i = 0;
+	history_refresh();
+	if(argc > 1){
+		i = count - atoi(argv[1]);
+		if(i < 0){
+			i = 0;
+		}
+	}
+	for(; i < count; i++){
+		entry = history_entry(i, &len);
+		printf("%5d  %.*s\n", i + 1, len, entry);
+	}
+	return 0;
+}
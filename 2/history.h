@@ -0,0 +1,36 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+//append-only history file: one entry per line, shared by all the
+//shells of the user. The file is mapped into memory and the index of
+//line starts is extended only by the lines, added since the last look
+
+//$HISTFILE or ~/.shell_history. -1, if it can not be opened, then the
+//history is empty
+int history_open();
+
+void history_close();
+
+//pick up the entries, appended by other shells
+void history_refresh();
+
+//number of the entries, the oldest one is 0
+int history_count();
+
+//text of an entry without the newline, it is not terminated. Valid
+//until the next call of history_refresh() or history_add()
+const char* history_entry(int i, int* len);
+
+//append a line under an exclusive flock(), so the lines of concurrent
+//shells are not mixed. Blank lines and repeats of the last entry are
+//skipped
+void history_add(const char* line, int len);
+
+//the newest entry <= from, which contains the query, -1 if there is
+//none
+int history_search(const char* query, int len, int from);
+
+//history [n]: the last n entries or all of them
+int builtin_history(int argc, char** argv);
+
+#endif
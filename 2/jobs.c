@@ -0,0 +1,324 @@
+#define _GNU_SOURCE
+#include "jobs.h"
+#include "lexer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+static struct job* first_job = NULL;
+static bool is_jobs_interactive = 0;
+static int sigchld_pipe[2] = {-1, -1};
+//set by the handler, so jobs_reap() costs nothing between lines,
+//when no child has finished
+static volatile sig_atomic_t is_sigchld = 0;
+
+int exit_code_of(int status)
+{
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+static void on_sigchld(int sig)
+{
+	int saved_errno = errno;
+	char c = 0;
+	ssize_t rc;
+	(void)sig;
+	is_sigchld = 1;
+	//the pipe is non-blocking, a full pipe is readable anyway
+	rc = write(sigchld_pipe[1], &c, 1);
+	(void)rc;
+	errno = saved_errno;
+}
+
+void jobs_init(bool is_interactive)
+{
+	struct sigaction sa;
+	is_jobs_interactive = is_interactive;
+	if(pipe2(sigchld_pipe, O_CLOEXEC|O_NONBLOCK) != 0){
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_sigchld;
+	sa.sa_flags = SA_RESTART|SA_NOCLDSTOP;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
+}
+
+int jobs_fd()
+{
+	return sigchld_pipe[0];
+}
+
+void jobs_child_reset()
+{
+	signal(SIGCHLD, SIG_DFL);
+	if(sigchld_pipe[0] != -1){
+		close(sigchld_pipe[0]);
+		close(sigchld_pipe[1]);
+		sigchld_pipe[0] = -1;
+		sigchld_pipe[1] = -1;
+	}
+	//the memory is left to the parent copy, only the list is dropped
+	first_job = NULL;
+}
+
+struct job* job_add(struct node* n, pid_t* pids, int* exit_codes,
+	int count)
+{
+	struct job* job = (struct job*)malloc(sizeof(struct job));
+	struct job** last = &first_job;
+	struct buffer* buf = create_buffer(64);
+	int i;
+	job->id = 1;
+	while(*last){
+		job->id = (*last)->id + 1;
+		last = &(*last)->next;
+	}
+	job->count = count;
+	job->pids = (pid_t*)malloc(count * sizeof(pid_t));
+	job->exit_codes = (int*)malloc(count * sizeof(int));
+	job->alive = 0;
+	for(i = 0; i < count; i++){
+		job->pids[i] = pids[i];
+		job->exit_codes[i] = exit_codes[i];
+		if(pids[i] != -1){
+			job->alive++;
+		}
+	}
+	format_node(n, buf);
+	insert_buffer(buf, 0);
+	job->text = strdup(buf->array);
+	free_buffer(buf);
+	job->next = NULL;
+	*last = job;
+	if(is_jobs_interactive){
+		printf("[%d] %d\n", job->id, pids[count - 1]);
+		fflush(stdout);
+	}
+	return job;
+}
+
+static void free_job(struct job* job)
+{
+	free(job->pids);
+	free(job->exit_codes);
+	free(job->text);
+	free(job);
+}
+
+static void remove_job(struct job* job)
+{
+	struct job** p = &first_job;
+	while(*p != job){
+		p = &(*p)->next;
+	}
+	*p = job->next;
+	free_job(job);
+}
+
+static int job_exit_code(struct job* job)
+{
+	return job->exit_codes[job->count - 1];
+}
+
+static const char* job_state(struct job* job, char* str, int size)
+{
+	if(job->alive > 0){
+		return "Running";
+	}
+	if(job_exit_code(job) == 0){
+		return "Done";
+	}
+	snprintf(str, size, "Exit %d", job_exit_code(job));
+	return str;
+}
+
+static void print_job(struct job* job, bool is_pids)
+{
+	char state[32];
+	printf("[%d]  %-22s %s", job->id, job_state(job, state,
+		sizeof(state)), job->text);
+	if(is_pids){
+		int i;
+		for(i = 0; i < job->count; i++){
+			if(job->pids[i] != -1){
+				printf(" %d", job->pids[i]);
+			}
+		}
+	}
+	printf("\n");
+}
+
+//mark a reaped process, false if it does not belong to any job
+static bool job_reaped(pid_t pid, int status)
+{
+	struct job* job;
+	int i;
+	for(job = first_job; job; job = job->next){
+		for(i = 0; i < job->count; i++){
+			if(job->pids[i] == pid){
+				job->pids[i] = -1;
+				job->exit_codes[i] = exit_code_of(status);
+				job->alive--;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void reap_children()
+{
+	char drain[64];
+	pid_t pid;
+	int status;
+	is_sigchld = 0;
+	while(read(sigchld_pipe[0], drain, sizeof(drain)) > 0){
+	}
+	while((pid = waitpid(-1, &status, WNOHANG)) > 0){
+		job_reaped(pid, status);
+	}
+}
+
+void jobs_reap()
+{
+	struct job* job;
+	struct job* next;
+	if(!is_sigchld){
+		return;
+	}
+	reap_children();
+	for(job = first_job; job; job = next){
+		next = job->next;
+		if(job->alive > 0){
+			continue;
+		}
+		if(is_jobs_interactive){
+			print_job(job, 0);
+		}
+		remove_job(job);
+	}
+	fflush(stdout);
+}
+
+static int wait_job(struct job* job)
+{
+	int exit_code;
+	int i;
+	for(i = 0; i < job->count; i++){
+		int status;
+		pid_t pid = job->pids[i];
+		if(pid != -1 && waitpid(pid, &status, 0) == pid){
+			job_reaped(pid, status);
+		}
+	}
+	exit_code = job_exit_code(job);
+	remove_job(job);
+	return exit_code;
+}
+
+//%N, %% or %+ for the last job, or a pid of some job process
+static struct job* find_job(const char* spec, pid_t* pid)
+{
+	struct job* job;
+	struct job* last = NULL;
+	*pid = -1;
+	if(spec[0] == '%'){
+		int id = atoi(spec + 1);
+		for(job = first_job; job; job = job->next){
+			last = job;
+			if(job->id == id){
+				return job;
+			}
+		}
+		return strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0 ||
+			strcmp(spec, "%") == 0 ? last : NULL;
+	}
+	*pid = atoi(spec);
+	for(job = first_job; job; job = job->next){
+		int i;
+		for(i = 0; i < job->count; i++){
+			if(job->pids[i] == *pid){
+				return job;
+			}
+		}
+	}
+	return NULL;
+}
+
+int builtin_jobs(int argc, char** argv)
+{
+	bool is_pids = argc > 1 && strcmp(argv[1], "-l") == 0;
+	struct job* job;
+	struct job* next;
+	reap_children();
+	for(job = first_job; job; job = next){
+		next = job->next;
+		print_job(job, is_pids);
+		if(job->alive == 0){
+			remove_job(job);
+		}
+	}
+	return 0;
+}
+
+//wait for all jobs or for the given jobs and pids, the result is the
+//exit code of the last one
+int builtin_wait(int argc, char** argv)
+{
+	int exit_code = 0;
+	int i;
+	if(argc == 1){
+		while(first_job){
+			wait_job(first_job);
+		}
+		return 0;
+	}
+	for(i = 1; i < argc; i++){
+		pid_t pid;
+		int status;
+		struct job* job = find_job(argv[i], &pid);
+		int k;
+		if(job == NULL){
+			fprintf(stderr, "wait: %s: no such job\n", argv[i]);
+			exit_code = 127;
+			continue;
+		}
+		if(pid == -1){
+			exit_code = wait_job(job);
+			continue;
+		}
+		//one process of a job, the job stays until all are reaped
+		for(k = 0; k < job->count && job->pids[k] != pid; k++){
+		}
+		if(waitpid(pid, &status, 0) == pid){
+			job_reaped(pid, status);
+		}
+		exit_code = job->exit_codes[k];
+		if(job->alive == 0){
+			remove_job(job);
+		}
+	}
+	return exit_code;
+}
+
+//there is no terminal control, fg just makes the shell wait for a job
+int builtin_fg(int argc, char** argv)
+{
+	pid_t pid;
+	struct job* job = find_job(argc > 1 ? argv[1] : "%%", &pid);
+	if(job == NULL){
+		fprintf(stderr, "fg: %s: no such job\n",
+			argc > 1 ? argv[1] : "current");
+		return 1;
+	}
+	printf("%s\n", job->text);
+	fflush(stdout);
+	return wait_job(job);
+}
@@ -0,0 +1,48 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "parser.h"
+
+//a background pipeline or a subshell, pids of all its processes are
+//kept to wait for the job as a whole or for each pid
+struct job{
+	int id;
+	int count;
+	pid_t* pids;
+	//filled in, when a process is reaped
+	int* exit_codes;
+	//how many processes are not reaped yet
+	int alive;
+	char* text;
+	struct job* next;
+};
+
+int exit_code_of(int status);
+
+//messages about jobs are printed only for an interactive shell.
+//Children are reaped on SIGCHLD, which is turned into a readable
+//byte in jobs_fd(), to poll it with the input
+void jobs_init(bool is_interactive);
+
+int jobs_fd();
+
+//reap finished children, report and forget finished jobs
+void jobs_reap();
+
+//a forked shell does not own the jobs of its parent
+void jobs_child_reset();
+
+//register processes of a background item, pid -1 means that there
+//is no process and its exit code is already known
+struct job* job_add(struct node* n, pid_t* pids, int* exit_codes,
+	int count);
+
+int builtin_jobs(int argc, char** argv);
+
+int builtin_wait(int argc, char** argv);
+
+int builtin_fg(int argc, char** argv);
+
+#endif
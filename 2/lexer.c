@@ -0,0 +1,791 @@
+#include "lexer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct buffer* create_buffer(int len)
+{
+	struct buffer* buf = (struct buffer*)malloc(sizeof(struct buffer));
+	buf->len = len;
+	buf->pos = 0;
+	buf->array = (char*)malloc(len*sizeof(char));
+	return buf;
+}
+
+void free_buffer(struct buffer* buf)
+{
+	free(buf->array);
+	free(buf);
+}
+
+void reserve_buffer(struct buffer* buf, int n)
+{
+	if(buf->pos + n <= buf->len){
+		return;
+	}
+	while(buf->pos + n > buf->len){
+		buf->len *= 2;
+	}
+	buf->array = (char*)realloc(buf->array, buf->len);
+	if(buf->array == NULL){
+		perror("realloc");
+		exit(EXIT_FAILURE);
+	}
+}
+
+void append_buffer(struct buffer* buf, const char* data, int n)
+{
+	reserve_buffer(buf, n);
+	memcpy(&buf->array[buf->pos], data, n);
+	buf->pos += n;
+}
+
+void insert_buffer(struct buffer* buf, char c)
+{
+	if(buf->pos == buf->len){
+		reserve_buffer(buf, 1);
+	}
+	buf->array[buf->pos++] = c;
+}
+
+enum char_class{
+	CHAR_PLAIN,
+	CHAR_BLANK,
+	CHAR_NEWLINE,
+	CHAR_OPERATOR,
+	CHAR_QUOTE_D,
+	CHAR_QUOTE_S,
+	CHAR_ESCAPE,
+	CHAR_COMMENT,
+	CHAR_DOLLAR
+};
+
+static const struct{
+	const char* str;
+	int type;
+} operators[] = {
+	{"|", TOKEN_PIPE},
+	{"||", TOKEN_OR},
+	{"&", TOKEN_AMP},
+	{"&&", TOKEN_AND},
+	{"<", TOKEN_READ},
+	{">", TOKEN_WRITE},
+	{">>", TOKEN_APPEND},
+	{"<<", TOKEN_HEREDOC},
+	{"<<-", TOKEN_HEREDOC_STRIP},
+	{"<<<", TOKEN_HERESTRING},
+	{";", TOKEN_SEMI},
+	{"(", TOKEN_LPAREN},
+	{")", TOKEN_RPAREN},
+};
+
+#define OPERATOR_COUNT (int)(sizeof(operators) / sizeof(operators[0]))
+
+//class of each input byte outside of quotes
+static char char_class[256];
+//true for bytes which keep the escape when escaped
+static bool need_escape[256];
+static bool is_glob_char[256];
+static bool is_classes_ready = 0;
+
+static void init_char_classes()
+{
+	const char* escape = "\n'\"\\ ><|&;()$";
+	int i;
+	char_class[' '] = CHAR_BLANK;
+	char_class['\t'] = CHAR_BLANK;
+	char_class['\n'] = CHAR_NEWLINE;
+	for(i = 0; i < OPERATOR_COUNT; i++){
+		char_class[(unsigned char)operators[i].str[0]] = CHAR_OPERATOR;
+	}
+	char_class['"'] = CHAR_QUOTE_D;
+	char_class['\''] = CHAR_QUOTE_S;
+	char_class['\\'] = CHAR_ESCAPE;
+	char_class['#'] = CHAR_COMMENT;
+	char_class['$'] = CHAR_DOLLAR;
+	is_glob_char['*'] = 1;
+	is_glob_char['?'] = 1;
+	is_glob_char['['] = 1;
+	is_glob_char[']'] = 1;
+	for(i = 0; escape[i]; i++){
+		need_escape[(unsigned char)escape[i]] = 1;
+	}
+	is_classes_ready = 1;
+}
+
+//length of the longest prefix of plain bytes, outside of quotes
+static int scan_plain(const char* p, const char* end)
+{
+	const char* start = p;
+	while(p < end && (char_class[(unsigned char)*p] == CHAR_PLAIN ||
+		char_class[(unsigned char)*p] == CHAR_COMMENT)){
+		p++;
+	}
+	return p - start;
+}
+
+//length of the longest prefix inside double quotes without ", escapes
+//and $
+static int scan_quote_d(const char* p, const char* end)
+{
+	const char* start = p;
+	while(p < end && *p != '"' && *p != '\\' && *p != '$'){
+		p++;
+	}
+	return p - start;
+}
+
+//-1 if not an operator
+static int operator_type(const char* str, int len)
+{
+	int i;
+	for(i = 0; i < OPERATOR_COUNT; i++){
+		if((int)strlen(operators[i].str) == len &&
+			memcmp(operators[i].str, str, len) == 0){
+			return operators[i].type;
+		}
+	}
+	return -1;
+}
+
+const char* token_name(struct token* t)
+{
+	int i;
+	if(t == NULL){
+		return "newline";
+	}
+	if(t->type == TOKEN_WORD){
+		return t->word;
+	}
+	for(i = 0; i < OPERATOR_COUNT; i++){
+		if(operators[i].type == t->type){
+			return operators[i].str;
+		}
+	}
+	return "?";
+}
+
+bool is_reserved(struct token* t, const char* word)
+{
+	return t && t->type == TOKEN_WORD && !t->is_quoted &&
+		t->expansions == NULL && strcmp(t->word, word) == 0;
+}
+
+void lexer_create(struct lexer* lx, struct arena* a, line_f on_line,
+	void* ctx)
+{
+	if(!is_classes_ready){
+		init_char_classes();
+	}
+	lx->arena = a;
+	lx->on_line = on_line;
+	lx->ctx = ctx;
+	lx->first = NULL;
+	lx->last = NULL;
+	lx->buf = create_buffer(32);
+	lx->op_len = 0;
+	lx->is_word = 0;
+	lx->is_quote_d = 0;
+	lx->is_quote_s = 0;
+	lx->is_escape = 0;
+	lx->is_comment = 0;
+	lx->is_quoted_word = 0;
+	lx->unquoted_len = -1;
+	lx->is_dollar = 0;
+	lx->is_var = 0;
+	lx->is_var_brace = 0;
+	lx->expansions = NULL;
+	lx->last_expansion = &lx->expansions;
+	lx->subst = create_buffer(32);
+	lx->subst_depth = 0;
+	lx->is_subst_quote_d = 0;
+	lx->is_subst_quote_s = 0;
+	lx->is_subst_escape = 0;
+	lx->group_depth = 0;
+	lx->is_last_reserved = 0;
+	lx->heredoc = NULL;
+	lx->heredoc_line_start = 0;
+}
+
+void lexer_destroy(struct lexer* lx)
+{
+	free_buffer(lx->buf);
+	free_buffer(lx->subst);
+}
+
+static bool is_command_start(struct lexer* lx);
+
+static void push_token(struct lexer* lx, int type, char* word)
+{
+	//( opens a subshell only where a command starts, otherwise the
+	//parser reports it
+	bool is_group = type == TOKEN_LPAREN && is_command_start(lx);
+	struct token* t = (struct token*)arena_alloc(lx->arena,
+		sizeof(struct token));
+	t->type = type;
+	t->word = word;
+	t->expansions = NULL;
+	t->is_quoted = 0;
+	t->is_assignment = 0;
+	t->next = NULL;
+	if(lx->first){
+		lx->last->next = t;
+	}else{
+		lx->first = t;
+	}
+	lx->last = t;
+	lx->is_last_reserved = 0;
+	if(is_group){
+		lx->group_depth++;
+	}else if(type == TOKEN_RPAREN && lx->group_depth > 0){
+		lx->group_depth--;
+	}
+}
+
+//{ and } are reserved only where a command starts: after an operator,
+//which separates commands, or after another reserved word
+static bool is_command_start(struct lexer* lx)
+{
+	struct token* t = lx->last;
+	if(t == NULL){
+		return 1;
+	}
+	switch(t->type){
+	case TOKEN_PIPE:
+	case TOKEN_OR:
+	case TOKEN_AMP:
+	case TOKEN_AND:
+	case TOKEN_SEMI:
+	case TOKEN_LPAREN:
+		return 1;
+	case TOKEN_WORD:
+		return lx->is_last_reserved;
+	}
+	return 0;
+}
+
+static bool is_name_char(char c)
+{
+	return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		(c >= '0' && c <= '9');
+}
+
+//NAME= is in the unquoted literal beginning of the word
+static bool is_assignment(const char* word, int unquoted_len)
+{
+	int i;
+	if(word[0] >= '0' && word[0] <= '9'){
+		return 0;
+	}
+	for(i = 0; is_name_char(word[i]); i++){
+	}
+	return i > 0 && word[i] == '=' && (unquoted_len == -1 ||
+		unquoted_len > i);
+}
+
+//the rest of the word is quoted or expanded
+static void mark_unquoted_end(struct lexer* lx)
+{
+	if(lx->unquoted_len == -1){
+		lx->unquoted_len = lx->buf->pos;
+	}
+}
+
+static void mark_quoted(struct lexer* lx)
+{
+	lx->is_quoted_word = 1;
+	mark_unquoted_end(lx);
+}
+
+static void end_word(struct lexer* lx)
+{
+	bool is_start;
+	struct token* t;
+	if(!lx->is_word){
+		return;
+	}
+	is_start = is_command_start(lx);
+	push_token(lx, TOKEN_WORD, arena_strdup(lx->arena, lx->buf->array,
+		lx->buf->pos));
+	t = lx->last;
+	t->expansions = lx->expansions;
+	t->is_quoted = lx->is_quoted_word;
+	t->is_assignment = is_assignment(t->word, lx->unquoted_len);
+	lx->buf->pos = 0;
+	lx->is_word = 0;
+	lx->is_quoted_word = 0;
+	lx->unquoted_len = -1;
+	lx->expansions = NULL;
+	lx->last_expansion = &lx->expansions;
+	if(is_start && is_reserved(t, "{")){
+		lx->group_depth++;
+		lx->is_last_reserved = 1;
+	}else if(is_start && is_reserved(t, "}") && lx->group_depth > 0){
+		lx->group_depth--;
+		lx->is_last_reserved = 1;
+	}
+}
+
+//$(...) and variables are collected in subst
+static void start_expansion(struct lexer* lx)
+{
+	lx->subst->pos = 0;
+	lx->is_word = 1;
+	mark_unquoted_end(lx);
+}
+
+static void end_expansion(struct lexer* lx, int type)
+{
+	struct expansion* e = (struct expansion*)arena_alloc(lx->arena,
+		sizeof(struct expansion));
+	e->type = type;
+	e->offset = lx->buf->pos;
+	e->is_quoted = lx->is_quote_d;
+	e->text = arena_strdup(lx->arena, lx->subst->array, lx->subst->pos);
+	e->next = NULL;
+	*lx->last_expansion = e;
+	lx->last_expansion = &e->next;
+	lx->subst->pos = 0;
+}
+
+//name of $NAME ends with the first byte, which can not be in a name
+static const char* feed_var(struct lexer* lx, const char* p,
+	const char* end)
+{
+	const char* start = p;
+	while(p < end && is_name_char(*p)){
+		p++;
+	}
+	append_buffer(lx->subst, start, p - start);
+	if(p < end){
+		lx->is_var = 0;
+		end_expansion(lx, EXPANSION_VARIABLE);
+	}
+	return p;
+}
+
+//unquoted glob characters of plain text, which is going to be appended
+//to the word
+static void mark_globs(struct lexer* lx, const char* p, int n)
+{
+	int i;
+	for(i = 0; i < n; i++){
+		if(!is_glob_char[(unsigned char)p[i]]){
+			continue;
+		}
+		struct expansion* e = (struct expansion*)arena_alloc(lx->arena,
+			sizeof(struct expansion));
+		e->type = EXPANSION_GLOB;
+		e->offset = lx->buf->pos + i;
+		e->is_quoted = 0;
+		e->text = NULL;
+		e->next = NULL;
+		*lx->last_expansion = e;
+		lx->last_expansion = &e->next;
+	}
+}
+
+//text of $(...) is only scanned for the closing parenthesis, it is
+//split into tokens, when the command is executed
+static const char* feed_subst(struct lexer* lx, const char* p,
+	const char* end)
+{
+	for(; p < end; p++){
+		char c = *p;
+		if(lx->is_subst_escape){
+			lx->is_subst_escape = 0;
+		}else if(lx->is_subst_quote_s){
+			lx->is_subst_quote_s = c != '\'';
+		}else if(c == '\\'){
+			lx->is_subst_escape = 1;
+		}else if(lx->is_subst_quote_d){
+			lx->is_subst_quote_d = c != '"';
+		}else if(c == '\''){
+			lx->is_subst_quote_s = 1;
+		}else if(c == '"'){
+			lx->is_subst_quote_d = 1;
+		}else if(c == '('){
+			lx->subst_depth++;
+		}else if(c == ')' && --lx->subst_depth == 0){
+			end_expansion(lx, EXPANSION_COMMAND);
+			return p + 1;
+		}
+		insert_buffer(lx->subst, c);
+	}
+	return end;
+}
+
+static void end_operator(struct lexer* lx)
+{
+	if(lx->op_len == 0){
+		return;
+	}
+	push_token(lx, operator_type(lx->op, lx->op_len), NULL);
+	lx->op_len = 0;
+}
+
+//true if c continues the current operator, as - of <<-
+static bool extend_operator(struct lexer* lx, char c)
+{
+	if(lx->op_len > 0 && lx->op_len + 1 < (int)sizeof(lx->op)){
+		lx->op[lx->op_len] = c;
+		if(operator_type(lx->op, lx->op_len + 1) != -1){
+			lx->op_len++;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//operators are built greedily: a char is appended to the current
+//operator while the result is still an operator
+static void lex_operator(struct lexer* lx, char c)
+{
+	end_word(lx);
+	if(extend_operator(lx, c)){
+		return;
+	}
+	end_operator(lx);
+	lx->op[0] = c;
+	lx->op_len = 1;
+}
+
+static void dispatch_line(struct lexer* lx)
+{
+	struct token* tokens = lx->first;
+	lx->first = NULL;
+	lx->last = NULL;
+	lx->group_depth = 0;
+	lx->on_line(tokens, lx->ctx);
+}
+
+//forget the current line after an error
+static void discard_line(struct lexer* lx)
+{
+	lx->buf->pos = 0;
+	lx->is_word = 0;
+	lx->is_quoted_word = 0;
+	lx->expansions = NULL;
+	lx->last_expansion = &lx->expansions;
+	lx->unquoted_len = -1;
+	lx->first = NULL;
+	lx->last = NULL;
+	lx->group_depth = 0;
+}
+
+//a here-document without a body yet. Inside a group lines of the
+//group are collected together, bodies of the previous ones are read
+static bool is_heredoc(struct token* t)
+{
+	return (t->type == TOKEN_HEREDOC || t->type == TOKEN_HEREDOC_STRIP) &&
+		t->word == NULL && t->next && t->next->type == TOKEN_WORD;
+}
+
+//the first here-document starting from t, NULL if there are no more
+static struct token* next_heredoc(struct token* t)
+{
+	while(t && !is_heredoc(t)){
+		t = t->next;
+	}
+	return t;
+}
+
+static void end_line(struct lexer* lx)
+{
+	struct token* t;
+	end_word(lx);
+	end_operator(lx);
+	//inside a group a newline after a command ends it, as ; does
+	t = lx->last;
+	if(lx->group_depth > 0 && t && (t->type == TOKEN_RPAREN ||
+		(t->type == TOKEN_WORD && !(lx->is_last_reserved &&
+		is_reserved(t, "{"))))){
+		push_token(lx, TOKEN_SEMI, NULL);
+	}
+	lx->heredoc = next_heredoc(lx->first);
+	if(lx->heredoc == NULL && lx->group_depth == 0){
+		dispatch_line(lx);
+	}
+}
+
+//the body is complete, go to the next here-document of the line or
+//pass the line on
+static void end_heredoc(struct lexer* lx)
+{
+	lx->heredoc->word = arena_strdup(lx->arena, lx->buf->array,
+		lx->buf->pos);
+	lx->buf->pos = 0;
+	lx->heredoc_line_start = 0;
+	lx->heredoc = next_heredoc(lx->heredoc->next->next);
+	if(lx->heredoc == NULL && lx->group_depth == 0){
+		dispatch_line(lx);
+	}
+}
+
+//a body line is complete in buf from heredoc_line_start, it is either
+//the delimiter or a part of the body
+static void heredoc_line(struct lexer* lx)
+{
+	char* line = lx->buf->array + lx->heredoc_line_start;
+	int len = lx->buf->pos - lx->heredoc_line_start;
+	const char* delim = lx->heredoc->next->word;
+	if(lx->heredoc->type == TOKEN_HEREDOC_STRIP){
+		int tabs = 0;
+		while(tabs < len && line[tabs] == '\t'){
+			tabs++;
+		}
+		memmove(line, line + tabs, len - tabs);
+		len -= tabs;
+		lx->buf->pos -= tabs;
+	}
+	if(len == (int)strlen(delim) && memcmp(line, delim, len) == 0){
+		lx->buf->pos = lx->heredoc_line_start;
+		end_heredoc(lx);
+		return;
+	}
+	insert_buffer(lx->buf, '\n');
+	lx->heredoc_line_start = lx->buf->pos;
+}
+
+//here-document bodies are taken as is, line by line
+static const char* feed_heredoc(struct lexer* lx, const char* p,
+	const char* end)
+{
+	const char* q = memchr(p, '\n', end - p);
+	if(q == NULL){
+		append_buffer(lx->buf, p, end - p);
+		return end;
+	}
+	append_buffer(lx->buf, p, q - p);
+	heredoc_line(lx);
+	return q + 1;
+}
+
+void lexer_feed(struct lexer* lx, const char* p, int len)
+{
+	const char* end = p + len;
+	while(p < end){
+		char c;
+		int n;
+		if(lx->heredoc){
+			p = feed_heredoc(lx, p, end);
+			continue;
+		}
+		if(lx->subst_depth > 0){
+			p = feed_subst(lx, p, end);
+			continue;
+		}
+		if(lx->is_var){
+			p = feed_var(lx, p, end);
+			continue;
+		}
+		if(lx->is_var_brace){
+			const char* q = memchr(p, '}', end - p);
+			if(q == NULL){
+				append_buffer(lx->subst, p, end - p);
+				return;
+			}
+			append_buffer(lx->subst, p, q - p);
+			p = q + 1;
+			lx->is_var_brace = 0;
+			end_expansion(lx, EXPANSION_VARIABLE);
+			continue;
+		}
+		if(lx->is_dollar){
+			lx->is_dollar = 0;
+			c = *p;
+			if(c == '('){
+				p++;
+				start_expansion(lx);
+				lx->subst_depth = 1;
+				continue;
+			}
+			if(c == '{'){
+				p++;
+				start_expansion(lx);
+				lx->is_var_brace = 1;
+				continue;
+			}
+			if(is_name_char(c) && !(c >= '0' && c <= '9')){
+				start_expansion(lx);
+				lx->is_var = 1;
+				continue;
+			}
+			//special parameters are one byte long
+			if(c == '?' || c == '$' || (c >= '0' && c <= '9')){
+				p++;
+				start_expansion(lx);
+				insert_buffer(lx->subst, c);
+				end_expansion(lx, EXPANSION_VARIABLE);
+				continue;
+			}
+			//not a substitution, the next byte is taken as usual
+			insert_buffer(lx->buf, '$');
+			lx->is_word = 1;
+			continue;
+		}
+		if(lx->is_comment){
+			const char* q = memchr(p, '\n', end - p);
+			if(q == NULL){
+				return;
+			}
+			p = q;
+			lx->is_comment = 0;
+			continue;
+		}
+		if(lx->is_escape){
+			c = *p++;
+			if(!need_escape[(unsigned char)c]){
+				insert_buffer(lx->buf, '\\');
+			}
+			if(c != '\n'){
+				insert_buffer(lx->buf, c);
+				lx->is_word = 1;
+			}
+			lx->is_escape = 0;
+			continue;
+		}
+		if(lx->is_quote_s){
+			const char* q = memchr(p, '\'', end - p);
+			if(q == NULL){
+				append_buffer(lx->buf, p, end - p);
+				return;
+			}
+			append_buffer(lx->buf, p, q - p);
+			p = q + 1;
+			lx->is_quote_s = 0;
+			continue;
+		}
+		if(lx->is_quote_d){
+			n = scan_quote_d(p, end);
+			append_buffer(lx->buf, p, n);
+			p += n;
+			if(p == end){
+				return;
+			}
+			c = *p++;
+			if(c == '"'){
+				lx->is_quote_d = 0;
+			}else if(c == '$'){
+				lx->is_dollar = 1;
+			}else{
+				lx->is_escape = 1;
+			}
+			continue;
+		}
+		c = *p;
+		if(char_class[(unsigned char)c] == CHAR_COMMENT && !lx->is_word){
+			end_operator(lx);
+			lx->is_comment = 1;
+			p++;
+			continue;
+		}
+		if(extend_operator(lx, c)){
+			p++;
+			continue;
+		}
+		n = scan_plain(p, end);
+		if(n > 0){
+			end_operator(lx);
+			mark_globs(lx, p, n);
+			append_buffer(lx->buf, p, n);
+			p += n;
+			lx->is_word = 1;
+			continue;
+		}
+		p++;
+		switch(char_class[(unsigned char)c]){
+		case CHAR_QUOTE_D:
+			end_operator(lx);
+			lx->is_quote_d = 1;
+			lx->is_word = 1;
+			mark_quoted(lx);
+			break;
+		case CHAR_QUOTE_S:
+			end_operator(lx);
+			lx->is_quote_s = 1;
+			lx->is_word = 1;
+			mark_quoted(lx);
+			break;
+		case CHAR_ESCAPE:
+			end_operator(lx);
+			lx->is_escape = 1;
+			mark_quoted(lx);
+			break;
+		case CHAR_DOLLAR:
+			end_operator(lx);
+			lx->is_dollar = 1;
+			break;
+		case CHAR_OPERATOR:
+			lex_operator(lx, c);
+			break;
+		case CHAR_BLANK:
+			end_word(lx);
+			end_operator(lx);
+			break;
+		case CHAR_NEWLINE:
+			end_line(lx);
+			break;
+		}
+	}
+}
+
+const char* lexer_finish(struct lexer* lx)
+{
+	if(lx->subst_depth > 0){
+		lx->subst_depth = 0;
+		lx->is_subst_quote_s = 0;
+		lx->is_subst_quote_d = 0;
+		lx->is_subst_escape = 0;
+		lx->is_quote_d = 0;
+		discard_line(lx);
+		return "unexpected EOF while looking for matching `)'";
+	}
+	if(lx->is_quote_s || lx->is_quote_d){
+		lx->is_quote_s = 0;
+		lx->is_quote_d = 0;
+		lx->is_dollar = 0;
+		discard_line(lx);
+		return "unexpected EOF while looking for matching quote";
+	}
+	if(lx->is_var_brace){
+		lx->is_var_brace = 0;
+		lx->is_quote_d = 0;
+		discard_line(lx);
+		return "unexpected EOF while looking for matching `}'";
+	}
+	if(lx->is_var){
+		lx->is_var = 0;
+		end_expansion(lx, EXPANSION_VARIABLE);
+	}
+	if(lx->is_dollar){
+		insert_buffer(lx->buf, '$');
+		lx->is_word = 1;
+		lx->is_dollar = 0;
+	}
+	lx->is_escape = 0;
+	lx->is_comment = 0;
+	if(lx->heredoc == NULL &&
+		(lx->is_word || lx->op_len > 0 || lx->first)){
+		end_line(lx);
+	}
+	//the last line without newline can be the delimiter
+	if(lx->heredoc && lx->buf->pos > lx->heredoc_line_start){
+		heredoc_line(lx);
+	}
+	if(lx->heredoc == NULL){
+		//an open group is passed on anyway, the parser reports it
+		if(lx->first){
+			dispatch_line(lx);
+		}
+		return NULL;
+	}
+	//as in bash, the body ends with the input, the rest are empty
+	while(lx->heredoc){
+		end_heredoc(lx);
+	}
+	if(lx->first){
+		dispatch_line(lx);
+	}
+	return "here-document delimited by end-of-file";
+}
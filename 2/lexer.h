@@ -0,0 +1,162 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stdbool.h>
+#include "arena.h"
+
+enum token_type{
+	TOKEN_WORD,
+	//|
+	TOKEN_PIPE,
+	//||
+	TOKEN_OR,
+	//&
+	TOKEN_AMP,
+	//&&
+	TOKEN_AND,
+	//<
+	TOKEN_READ,
+	//>
+	TOKEN_WRITE,
+	//>>
+	TOKEN_APPEND,
+	//<<, word of the token is the body, when the line is complete
+	TOKEN_HEREDOC,
+	//<<-, the same, leading tabs are removed from the body lines
+	TOKEN_HEREDOC_STRIP,
+	//<<<
+	TOKEN_HERESTRING,
+	//;
+	TOKEN_SEMI,
+	//(
+	TOKEN_LPAREN,
+	//)
+	TOKEN_RPAREN
+};
+
+enum expansion_type{
+	//$(...), text is the command
+	EXPANSION_COMMAND,
+	//$NAME or ${NAME}, text is the name
+	EXPANSION_VARIABLE,
+	//unquoted *, ?, [ or ] at offset of the word, text is NULL. The
+	//word is matched against paths
+	EXPANSION_GLOB
+};
+
+//a part of a word, which is known only at execution time. Its result
+//is inserted at offset into the literal text of the word
+struct expansion{
+	int type;
+	int offset;
+	//inside double quotes, the result is not split into fields
+	bool is_quoted;
+	char* text;
+	struct expansion* next;
+};
+
+struct token{
+	int type;
+	//not NULL only for words
+	char* word;
+	//expansions of the word in order of offsets
+	struct expansion* expansions;
+	//some part of the word was quoted or escaped, so it is not a
+	//reserved word as { or }
+	bool is_quoted;
+	//NAME=value with unquoted NAME=
+	bool is_assignment;
+	struct token* next;
+};
+
+struct buffer{
+	int len;
+	int pos;
+	char* array;
+};
+
+struct buffer* create_buffer(int len);
+
+void free_buffer(struct buffer* buf);
+
+//make room for at least n more bytes
+void reserve_buffer(struct buffer* buf, int n);
+
+void append_buffer(struct buffer* buf, const char* data, int n);
+
+void insert_buffer(struct buffer* buf, char c);
+
+//called for each complete line, tokens are allocated in the
+//lexer arena and live until it is reset
+typedef void (*line_f)(struct token* tokens, void* ctx);
+
+struct lexer{
+	struct arena* arena;
+	line_f on_line;
+	void* ctx;
+	struct token* first;
+	struct token* last;
+	//current word
+	struct buffer* buf;
+	//current operator, can be a prefix of a longer one
+	char op[4];
+	int op_len;
+	//true if the current word is started, even if it is empty
+	bool is_word;
+	bool is_quote_d;
+	bool is_quote_s;
+	bool is_escape;
+	bool is_comment;
+	//the current word has quotes or escapes
+	bool is_quoted_word;
+	//length of the unquoted literal beginning of the current word, -1
+	//if all of it is such
+	int unquoted_len;
+	//$ is the last byte of a block, it can start $(
+	bool is_dollar;
+	//$NAME and ${NAME} being read, the name is collected in subst
+	bool is_var;
+	bool is_var_brace;
+	struct expansion* expansions;
+	struct expansion** last_expansion;
+	//$(...) being read: its text and depth of parentheses, 0 outside.
+	//The text is taken as is, quotes only hide parentheses
+	struct buffer* subst;
+	int subst_depth;
+	bool is_subst_quote_d;
+	bool is_subst_quote_s;
+	bool is_subst_escape;
+	//open ( and { of the line, the line is passed on only when all
+	//of them are closed, newlines inside are separators
+	int group_depth;
+	//the last token is { or }, which has opened or closed a group
+	bool is_last_reserved;
+	//here-document, which body is being read, after the line with
+	//it has ended. Lines of the body are collected in buf
+	struct token* heredoc;
+	int heredoc_line_start;
+};
+
+void lexer_create(struct lexer* lx, struct arena* a, line_f on_line,
+	void* ctx);
+
+void lexer_destroy(struct lexer* lx);
+
+//split a block of input into tokens, on each unquoted newline
+//call on_line, the state is kept, so a token can span blocks. A line
+//with here-documents is passed on after their bodies, a line with an
+//open group - after the group is closed
+void lexer_feed(struct lexer* lx, const char* p, int len);
+
+//end of input, finish the last line even without newline. NULL or
+//an error message, if the input ends inside quotes, $(...) or
+//here-document
+const char* lexer_finish(struct lexer* lx);
+
+//name of a token for error messages
+const char* token_name(struct token* t);
+
+//true for an unquoted word, which is the reserved word
+bool is_reserved(struct token* t, const char* word);
+
+#endif
@@ -0,0 +1,314 @@
+#define _GNU_SOURCE
+#include "parallel.h"
+#include "arena.h"
+#include "lexer.h"
+#include "parser.h"
+#include "exec.h"
+#include "jobs.h"
+#include "stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#define PARALLEL_READ_SIZE 65536
+#define PARALLEL_FAILED_MAX 101
+
+struct parallel_line{
+	struct node* root;
+	const char* error;
+	pid_t pid;
+	//read ends of stdout and stderr pipes, -1 after EOF
+	int fds[2];
+	struct buffer* output[2];
+	int exit_code;
+	bool is_done;
+};
+
+//lines are added by the lexer while stdin is read, the ones before
+//them are running already
+struct parallel{
+	struct arena arena;
+	struct lexer lexer;
+	char* block;
+	//stdin is not at EOF yet
+	bool is_input;
+	bool is_read_error;
+	struct parallel_line* lines;
+	int count;
+	int capacity;
+};
+
+static void parallel_add(struct token* tokens, void* ctx)
+{
+	struct parallel* p = (struct parallel*)ctx;
+	struct parallel_line* line;
+	const char* error;
+	struct node* root = parse_line(tokens, &p->arena, &error);
+	if(root == NULL && error == NULL){
+		return;
+	}
+	if(p->count == p->capacity){
+		p->capacity = p->capacity ? p->capacity * 2 : 64;
+		p->lines = (struct parallel_line*)realloc(p->lines,
+			p->capacity * sizeof(struct parallel_line));
+	}
+	line = &p->lines[p->count++];
+	memset(line, 0, sizeof(*line));
+	line->root = root;
+	line->error = error;
+	line->pid = -1;
+	line->fds[0] = -1;
+	line->fds[1] = -1;
+}
+
+//one block of stdin, its complete lines are added. At EOF the lexer
+//is finished, then the input is over
+static void read_lines(struct parallel* p)
+{
+	const char* error;
+	int n = read(0, p->block, PARALLEL_READ_SIZE);
+	if(n < 0 && errno == EINTR){
+		return;
+	}
+	if(n > 0){
+		lexer_feed(&p->lexer, p->block, n);
+		return;
+	}
+	if(n < 0){
+		perror("parallel");
+		p->is_read_error = 1;
+	}
+	error = lexer_finish(&p->lexer);
+	if(error){
+		fprintf(stderr, "parallel: %s\n", error);
+	}
+	p->is_input = 0;
+}
+
+//each line is run by a forked shell, its stdout and stderr go into
+//pipes, which the parent collects. Its stdin is /dev/null, the rest
+//of the lines is not for it
+static void start_line(struct parallel_line* line)
+{
+	int out[2];
+	int err[2];
+	line->output[0] = create_buffer(4096);
+	line->output[1] = create_buffer(256);
+	if(line->error){
+		append_buffer(line->output[1], line->error, strlen(line->error));
+		insert_buffer(line->output[1], '\n');
+		line->exit_code = 2;
+		return;
+	}
+	if(pipe2(out, O_CLOEXEC) != 0){
+		perror("pipe");
+		line->exit_code = 1;
+		return;
+	}
+	if(pipe2(err, O_CLOEXEC) != 0){
+		perror("pipe");
+		close(out[0]);
+		close(out[1]);
+		line->exit_code = 1;
+		return;
+	}
+	fflush(stdout);
+	fflush(stderr);
+	if((line->pid = fork()) == 0){
+		int null_fd = open("/dev/null", O_RDONLY);
+		jobs_child_reset();
+		if(null_fd != -1){
+			dup2(null_fd, 0);
+			close(null_fd);
+		}
+		dup2(out[1], 1);
+		dup2(err[1], 2);
+		exit(execute_line(line->root));
+	}
+	close(out[1]);
+	close(err[1]);
+	if(line->pid == -1){
+		perror("fork");
+		close(out[0]);
+		close(err[0]);
+		line->exit_code = 1;
+		return;
+	}
+	line->fds[0] = out[0];
+	line->fds[1] = err[0];
+}
+
+static bool is_line_running(struct parallel_line* line)
+{
+	return line->fds[0] != -1 || line->fds[1] != -1;
+}
+
+//when both pipes are closed, only the exit code is left to get
+static void finish_line(struct parallel_line* line)
+{
+	int status;
+	if(line->pid != -1 && waitpid(line->pid, &status, 0) == line->pid){
+		line->exit_code = exit_code_of(status);
+	}
+	line->is_done = 1;
+}
+
+static void print_line(struct parallel_line* line)
+{
+	write_all(1, line->output[0]->array, line->output[0]->pos);
+	write_all(2, line->output[1]->array, line->output[1]->pos);
+	free_buffer(line->output[0]);
+	free_buffer(line->output[1]);
+	line->output[0] = NULL;
+	line->output[1] = NULL;
+}
+
+static void read_output(struct parallel_line* line, int i)
+{
+	struct buffer* buf = line->output[i];
+	int n;
+	reserve_buffer(buf, PARALLEL_READ_SIZE);
+	n = read(line->fds[i], buf->array + buf->pos, buf->len - buf->pos);
+	if(n < 0 && errno == EINTR){
+		return;
+	}
+	if(n <= 0){
+		close(line->fds[i]);
+		line->fds[i] = -1;
+		return;
+	}
+	buf->pos += n;
+}
+
+static int parse_args(int argc, char** argv, int* max, bool* is_keep)
+{
+	int i;
+	long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+	*max = cpu_count > 0 ? cpu_count : 1;
+	*is_keep = 0;
+	for(i = 1; i < argc; i++){
+		const char* value = NULL;
+		if(strcmp(argv[i], "-k") == 0){
+			*is_keep = 1;
+			continue;
+		}
+		if(strcmp(argv[i], "-j") == 0 && i + 1 < argc){
+			value = argv[++i];
+		}else if(strncmp(argv[i], "-j", 2) == 0 && argv[i][2]){
+			value = argv[i] + 2;
+		}
+		if(value == NULL || atoi(value) <= 0){
+			fprintf(stderr, "usage: parallel [-j N] [-k]\n");
+			return -1;
+		}
+		*max = atoi(value);
+	}
+	return 0;
+}
+
+int builtin_parallel(int argc, char** argv)
+{
+	struct parallel p;
+	struct pollfd* fds;
+	int* fd_lines;
+	int max;
+	bool is_keep;
+	int next = 0;
+	int printed = 0;
+	int running = 0;
+	int failed = 0;
+	int i;
+	if(parse_args(argc, argv, &max, &is_keep) != 0){
+		return 2;
+	}
+	arena_create(&p.arena);
+	lexer_create(&p.lexer, &p.arena, parallel_add, &p);
+	p.block = (char*)malloc(PARALLEL_READ_SIZE);
+	p.is_input = 1;
+	p.is_read_error = 0;
+	p.lines = NULL;
+	p.count = 0;
+	p.capacity = 0;
+	//stdin is one more descriptor to poll
+	fds = (struct pollfd*)malloc((2 * max + 1) * sizeof(struct pollfd));
+	fd_lines = (int*)malloc((2 * max + 1) * sizeof(int));
+	while(p.is_input || printed < p.count){
+		int fd_count = 0;
+		while(running < max && next < p.count){
+			start_line(&p.lines[next++]);
+			running++;
+		}
+		//lines, which are started first, are the first to check
+		for(i = printed; i < next; i++){
+			struct parallel_line* line = &p.lines[i];
+			if(!line->is_done && !is_line_running(line)){
+				finish_line(line);
+				running--;
+				failed += line->exit_code != 0;
+				if(!is_keep){
+					print_line(line);
+				}
+			}
+		}
+		while(printed < next && p.lines[printed].is_done){
+			if(is_keep){
+				print_line(&p.lines[printed]);
+			}
+			printed++;
+		}
+		for(i = printed; i < next; i++){
+			int k;
+			for(k = 0; k < 2; k++){
+				if(p.lines[i].fds[k] == -1){
+					continue;
+				}
+				fds[fd_count].fd = p.lines[i].fds[k];
+				fds[fd_count].events = POLLIN;
+				fd_lines[fd_count++] = i * 2 + k;
+			}
+		}
+		//lines are read only while there is a free slot for them, so
+		//a long input is not kept in memory, and the first lines
+		//start before the input is over
+		if(p.is_input && running < max && next == p.count){
+			fds[fd_count].fd = 0;
+			fds[fd_count].events = POLLIN;
+			fd_lines[fd_count++] = -1;
+		}
+		if(fd_count == 0 || (running < max && next < p.count)){
+			continue;
+		}
+		if(poll(fds, fd_count, -1) < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			perror("poll");
+			break;
+		}
+		for(i = 0; i < fd_count; i++){
+			if(fds[i].revents == 0){
+				continue;
+			}
+			if(fd_lines[i] == -1){
+				read_lines(&p);
+			}else{
+				read_output(&p.lines[fd_lines[i] / 2], fd_lines[i] % 2);
+			}
+		}
+	}
+	if(p.is_read_error && failed == 0){
+		failed = 1;
+	}
+	lexer_destroy(&p.lexer);
+	free(p.block);
+	free(fds);
+	free(fd_lines);
+	free(p.lines);
+	arena_destroy(&p.arena);
+	return failed > PARALLEL_FAILED_MAX ? PARALLEL_FAILED_MAX : failed;
+}
@@ -0,0 +1,11 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+//parallel [-j N] [-k]: run command lines from stdin, at most N at
+//once, N is the CPU count by default. Output of each line is
+//collected and printed at once, when the line is finished, in the
+//input order with -k. The result is the count of failed lines, but
+//not more than 101, as in GNU parallel
+int builtin_parallel(int argc, char** argv);
+
+#endif
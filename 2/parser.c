@@ -0,0 +1,440 @@
+#include "parser.h"
+#include <stdio.h>
+#include <string.h>
+
+//recursive descent parser, one function per grammar rule:
+//
+//line     := list?
+//list     := and_or ((';' | '&') and_or?)*
+//and_or   := pipeline (('&&' | '||') pipeline)*
+//pipeline := 'time'? command ('|' command)*
+//command  := (WORD | redirect)+ | group redirect*
+//group    := '(' list ')' | '{' list '}'
+//redirect := ('<' | '>' | '>>' | '<<' | '<<-' | '<<<') WORD
+//
+//{ and } are words, they are reserved only where a command starts
+
+struct parser{
+	struct token* tok;
+	struct arena* arena;
+	const char* error;
+};
+
+static struct node* new_node(struct parser* p, int type)
+{
+	struct node* n = (struct node*)arena_alloc(p->arena,
+		sizeof(struct node));
+	memset(n, 0, sizeof(struct node));
+	n->type = type;
+	return n;
+}
+
+static struct node* new_pair(struct parser* p, int type,
+	struct node* left, struct node* right)
+{
+	struct node* n = new_node(p, type);
+	n->pair.left = left;
+	n->pair.right = right;
+	return n;
+}
+
+static void syntax_error(struct parser* p)
+{
+	const char* fmt = "syntax error near unexpected token `%s'";
+	const char* name = token_name(p->tok);
+	int len;
+	char* error;
+	if(p->error){
+		return;
+	}
+	len = strlen(fmt) + strlen(name);
+	error = (char*)arena_alloc(p->arena, len);
+	snprintf(error, len, fmt, name);
+	p->error = error;
+}
+
+static bool is_redirect(struct token* t)
+{
+	return t && (t->type == TOKEN_READ || t->type == TOKEN_WRITE ||
+		t->type == TOKEN_APPEND || t->type == TOKEN_HEREDOC ||
+		t->type == TOKEN_HEREDOC_STRIP || t->type == TOKEN_HERESTRING);
+}
+
+static int redirect_type(struct token* t)
+{
+	switch(t->type){
+	case TOKEN_READ:
+		return REDIRECT_READ;
+	case TOKEN_WRITE:
+		return REDIRECT_WRITE;
+	case TOKEN_APPEND:
+		return REDIRECT_APPEND;
+	case TOKEN_HERESTRING:
+		return REDIRECT_HERESTRING;
+	}
+	return REDIRECT_HEREDOC;
+}
+
+static struct redirect* new_redirect(struct parser* p, struct token* t)
+{
+	struct redirect* r = (struct redirect*)arena_alloc(p->arena,
+		sizeof(struct redirect));
+	r->type = redirect_type(t);
+	//the lexer has put a here-document body into the operator
+	if(r->type == REDIRECT_HEREDOC){
+		r->path = t->word;
+		r->expansions = NULL;
+	}else{
+		r->path = t->next->word;
+		r->expansions = t->next->expansions;
+	}
+	r->next = NULL;
+	return r;
+}
+
+static struct node* parse_list(struct parser* p);
+
+//redirects after a group
+static struct redirect* parse_redirects(struct parser* p)
+{
+	struct redirect* first = NULL;
+	struct redirect** last = &first;
+	while(is_redirect(p->tok)){
+		if(p->tok->next == NULL || p->tok->next->type != TOKEN_WORD){
+			p->tok = p->tok->next;
+			syntax_error(p);
+			return NULL;
+		}
+		*last = new_redirect(p, p->tok);
+		last = &(*last)->next;
+		p->tok = p->tok->next->next;
+	}
+	return first;
+}
+
+//the list of a group ends with the closing ) or }
+static struct node* parse_group(struct parser* p)
+{
+	bool is_brace = p->tok->type == TOKEN_WORD;
+	struct node* n = new_node(p, is_brace ? NODE_GROUP : NODE_SUBSHELL);
+	p->tok = p->tok->next;
+	n->group.body = parse_list(p);
+	if(n->group.body == NULL){
+		syntax_error(p);
+		return NULL;
+	}
+	if(is_brace ? !is_reserved(p->tok, "}") :
+		p->tok == NULL || p->tok->type != TOKEN_RPAREN){
+		syntax_error(p);
+		return NULL;
+	}
+	p->tok = p->tok->next;
+	n->group.redirects = parse_redirects(p);
+	return p->error ? NULL : n;
+}
+
+static struct node* parse_command(struct parser* p)
+{
+	struct node* n;
+	struct redirect** last_redirect;
+	struct token* t;
+	int argc = 0;
+	int assign_count = 0;
+	bool has_expansions = 0;
+	if(p->tok && (p->tok->type == TOKEN_LPAREN ||
+		is_reserved(p->tok, "{"))){
+		return parse_group(p);
+	}
+	if(is_reserved(p->tok, "}")){
+		syntax_error(p);
+		return NULL;
+	}
+	for(t = p->tok; t && (t->type == TOKEN_WORD || is_redirect(t));
+		t = t->next){
+		if(t->type == TOKEN_WORD){
+			if(t->is_assignment && assign_count == argc){
+				assign_count++;
+			}
+			argc++;
+			has_expansions |= t->expansions != NULL;
+		}else if(t->next && t->next->type == TOKEN_WORD){
+			t = t->next;
+		}else{
+			p->tok = t->next;
+			syntax_error(p);
+			return NULL;
+		}
+	}
+	if(t == p->tok){
+		syntax_error(p);
+		return NULL;
+	}
+	n = new_node(p, NODE_COMMAND);
+	n->command.argc = argc;
+	n->command.assign_count = assign_count;
+	n->command.argv = (char**)arena_alloc(p->arena,
+		(argc + 1) * sizeof(char*));
+	if(has_expansions){
+		n->command.expansions = (struct expansion**)arena_alloc(
+			p->arena, argc * sizeof(struct expansion*));
+	}
+	last_redirect = &n->command.redirects;
+	argc = 0;
+	for(t = p->tok; t && (t->type == TOKEN_WORD || is_redirect(t));
+		t = t->next){
+		if(t->type == TOKEN_WORD){
+			if(has_expansions){
+				n->command.expansions[argc] = t->expansions;
+			}
+			n->command.argv[argc++] = t->word;
+			continue;
+		}
+		*last_redirect = new_redirect(p, t);
+		last_redirect = &(*last_redirect)->next;
+		t = t->next;
+	}
+	n->command.argv[argc] = NULL;
+	p->tok = t;
+	return n;
+}
+
+struct stage_list{
+	struct node* stage;
+	struct stage_list* next;
+};
+
+//"time" is a keyword only before a command, "time" alone is the
+//program
+static bool is_time_keyword(struct token* t)
+{
+	return is_reserved(t, "time") && t->next &&
+		(t->next->type == TOKEN_WORD || t->next->type == TOKEN_LPAREN ||
+		is_redirect(t->next));
+}
+
+static struct node* parse_pipeline(struct parser* p)
+{
+	struct node* first;
+	struct stage_list* stages = NULL;
+	struct stage_list** last = &stages;
+	struct node* n;
+	bool is_timed = 0;
+	int count = 1;
+	int i;
+	if(p->tok && is_time_keyword(p->tok)){
+		is_timed = 1;
+		p->tok = p->tok->next;
+	}
+	first = parse_command(p);
+	if(first == NULL){
+		return NULL;
+	}
+	if(p->tok == NULL || p->tok->type != TOKEN_PIPE){
+		first->is_timed = is_timed;
+		return first;
+	}
+	//the number of stages is unknown until the end, so they are
+	//collected into a list first
+	while(p->tok && p->tok->type == TOKEN_PIPE){
+		struct stage_list* s;
+		p->tok = p->tok->next;
+		s = (struct stage_list*)arena_alloc(p->arena,
+			sizeof(struct stage_list));
+		s->stage = parse_command(p);
+		if(s->stage == NULL){
+			return NULL;
+		}
+		s->next = NULL;
+		*last = s;
+		last = &s->next;
+		count++;
+	}
+	n = new_node(p, NODE_PIPELINE);
+	n->is_timed = is_timed;
+	n->pipeline.count = count;
+	n->pipeline.stages = (struct node**)arena_alloc(p->arena,
+		count * sizeof(struct node*));
+	n->pipeline.stages[0] = first;
+	for(i = 1; stages; i++, stages = stages->next){
+		n->pipeline.stages[i] = stages->stage;
+	}
+	return n;
+}
+
+//the chain is right-deep, each link joins its left pipeline with the
+//first pipeline on its right: a && b || c is AND(a, OR(b, c)). So it
+//is built here and run in a loop with no recursion per operator
+static struct node* parse_and_or(struct parser* p)
+{
+	struct node* first = parse_pipeline(p);
+	struct node** last = &first;
+	while(first && p->tok && (p->tok->type == TOKEN_AND ||
+		p->tok->type == TOKEN_OR)){
+		int type = p->tok->type == TOKEN_AND ? NODE_AND : NODE_OR;
+		struct node* right;
+		p->tok = p->tok->next;
+		right = parse_pipeline(p);
+		if(right == NULL){
+			syntax_error(p);
+			return NULL;
+		}
+		*last = new_pair(p, type, *last, right);
+		last = &(*last)->pair.right;
+	}
+	return first;
+}
+
+//the list ends with the line or with a group
+static bool is_list_end(struct token* t)
+{
+	return t == NULL || t->type == TOKEN_RPAREN || is_reserved(t, "}");
+}
+
+//the sequence is right-deep too, items are added at the tail
+static struct node* parse_list(struct parser* p)
+{
+	struct node* first = NULL;
+	struct node** last = &first;
+	struct node* item;
+	while(1){
+		item = parse_and_or(p);
+		if(item == NULL){
+			return NULL;
+		}
+		if(p->tok == NULL || (p->tok->type != TOKEN_AMP &&
+			p->tok->type != TOKEN_SEMI)){
+			break;
+		}
+		if(p->tok->type == TOKEN_AMP){
+			struct node* bg = new_node(p, NODE_BACKGROUND);
+			bg->child = item;
+			item = bg;
+		}
+		p->tok = p->tok->next;
+		if(is_list_end(p->tok)){
+			break;
+		}
+		*last = new_pair(p, NODE_SEQUENCE, item, NULL);
+		last = &(*last)->pair.right;
+	}
+	*last = item;
+	return first;
+}
+
+struct node* parse_line(struct token* tokens, struct arena* a,
+	const char** error)
+{
+	struct parser p;
+	struct node* root;
+	*error = NULL;
+	if(tokens == NULL){
+		return NULL;
+	}
+	p.tok = tokens;
+	p.arena = a;
+	p.error = NULL;
+	root = parse_list(&p);
+	if(root && p.tok){
+		syntax_error(&p);
+	}
+	*error = p.error;
+	return p.error ? NULL : root;
+}
+
+static bool is_pair(struct node* n)
+{
+	return n->type == NODE_AND || n->type == NODE_OR ||
+		n->type == NODE_SEQUENCE;
+}
+
+void format_word(const char* word, struct expansion* e,
+	struct buffer* buf)
+{
+	int pos = 0;
+	for(; e; e = e->next){
+		append_buffer(buf, word + pos, e->offset - pos);
+		pos = e->offset;
+		if(e->type == EXPANSION_GLOB){
+			continue;
+		}
+		if(e->type == EXPANSION_COMMAND){
+			append_buffer(buf, "$(", 2);
+			append_buffer(buf, e->text, strlen(e->text));
+			insert_buffer(buf, ')');
+			continue;
+		}
+		append_buffer(buf, "${", 2);
+		append_buffer(buf, e->text, strlen(e->text));
+		insert_buffer(buf, '}');
+	}
+	append_buffer(buf, word + pos, strlen(word + pos));
+}
+
+void format_node(struct node* n, struct buffer* buf)
+{
+	struct node* last;
+	int i;
+	if(n->is_timed){
+		append_buffer(buf, "time ", 5);
+	}
+	switch(n->type){
+	case NODE_COMMAND:
+		for(i = 0; i < n->command.argc; i++){
+			if(i > 0){
+				insert_buffer(buf, ' ');
+			}
+			format_word(n->command.argv[i], n->command.expansions ?
+				n->command.expansions[i] : NULL, buf);
+		}
+		break;
+	case NODE_PIPELINE:
+		for(i = 0; i < n->pipeline.count; i++){
+			if(i > 0){
+				append_buffer(buf, " | ", 3);
+			}
+			format_node(n->pipeline.stages[i], buf);
+		}
+		break;
+	case NODE_AND:
+	case NODE_OR:
+	case NODE_SEQUENCE:
+		//chains are right-deep, they are walked in a loop
+		for(; is_pair(n); n = n->pair.right){
+			format_node(n->pair.left, buf);
+			if(n->type == NODE_AND){
+				append_buffer(buf, " && ", 4);
+			}else if(n->type == NODE_OR){
+				append_buffer(buf, " || ", 4);
+			}else if(n->pair.left->type == NODE_BACKGROUND){
+				insert_buffer(buf, ' ');
+			}else{
+				append_buffer(buf, "; ", 2);
+			}
+			if(n->pair.right == NULL){
+				return;
+			}
+		}
+		format_node(n, buf);
+		break;
+	case NODE_BACKGROUND:
+		format_node(n->child, buf);
+		append_buffer(buf, " &", 2);
+		break;
+	case NODE_SUBSHELL:
+		insert_buffer(buf, '(');
+		format_node(n->group.body, buf);
+		insert_buffer(buf, ')');
+		break;
+	case NODE_GROUP:
+		append_buffer(buf, "{ ", 2);
+		format_node(n->group.body, buf);
+		for(last = n->group.body; last->type == NODE_SEQUENCE &&
+			last->pair.right; last = last->pair.right){
+		}
+		if(last->type != NODE_BACKGROUND){
+			insert_buffer(buf, ';');
+		}
+		append_buffer(buf, " }", 2);
+		break;
+	}
+}
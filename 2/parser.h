@@ -0,0 +1,95 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "arena.h"
+#include "lexer.h"
+
+enum node_type{
+	//argv with redirects
+	NODE_COMMAND,
+	//commands connected with |
+	NODE_PIPELINE,
+	//left && right
+	NODE_AND,
+	//left || right
+	NODE_OR,
+	//left, then right, right can be NULL
+	NODE_SEQUENCE,
+	//child is executed without waiting for it
+	NODE_BACKGROUND,
+	//( list ), executed in a child
+	NODE_SUBSHELL,
+	//{ list; }, executed in the shell itself
+	NODE_GROUP
+};
+
+enum redirect_type{
+	//<
+	REDIRECT_READ,
+	//>
+	REDIRECT_WRITE,
+	//>>
+	REDIRECT_APPEND,
+	//<< and <<-, path is the body
+	REDIRECT_HEREDOC,
+	//<<<, path is the string
+	REDIRECT_HERESTRING
+};
+
+struct redirect{
+	int type;
+	//file path or the content for here-documents and strings
+	char* path;
+	//expansions of the path
+	struct expansion* expansions;
+	struct redirect* next;
+};
+
+struct command{
+	int argc;
+	//NULL-terminated
+	char** argv;
+	//the first words of argv are NAME=value assignments
+	int assign_count;
+	//NULL, if no word has expansions, otherwise expansions of each
+	//word of argv
+	struct expansion** expansions;
+	struct redirect* redirects;
+};
+
+struct node{
+	int type;
+	//a command or a pipeline with the time prefix
+	bool is_timed;
+	union{
+		struct command command;
+		struct{
+			int count;
+			struct node** stages;
+		} pipeline;
+		struct{
+			struct node* left;
+			struct node* right;
+		} pair;
+		struct node* child;
+		struct{
+			struct node* body;
+			struct redirect* redirects;
+		} group;
+	};
+};
+
+//build AST of one command line, all nodes are allocated in the
+//arena, NULL is returned for an empty line or a syntax error, then
+//*error is the message, otherwise NULL
+struct node* parse_line(struct token* tokens, struct arena* a,
+	const char** error);
+
+//append a command line text of the node
+void format_node(struct node* n, struct buffer* buf);
+
+//append a word with its expansions in the source form
+void format_word(const char* word, struct expansion* e,
+	struct buffer* buf);
+
+#endif
@@ -0,0 +1,322 @@
+#include "pathglob.h"
+#include "arena.h"
+#include "lexer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+struct dir_listing{
+	char* path;
+	//the listing is valid while the directory is not changed
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	int count;
+	char** names;
+	struct dir_listing* next;
+};
+
+//listings of the current command line, names are in the arena
+static struct dir_listing* listings = NULL;
+static struct arena listing_arena;
+static bool is_arena_ready = 0;
+
+struct matches{
+	char** paths;
+	int count;
+	int capacity;
+};
+
+void glob_cache_clear()
+{
+	while(listings){
+		struct dir_listing* l = listings;
+		listings = l->next;
+		free(l->names);
+		free(l);
+	}
+	if(is_arena_ready){
+		arena_reset(&listing_arena);
+	}
+}
+
+static bool is_same_dir(struct dir_listing* l, struct stat* st)
+{
+	return l->dev == st->st_dev && l->ino == st->st_ino &&
+		l->mtime.tv_sec == st->st_mtim.tv_sec &&
+		l->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+//names of a directory without . and .., NULL if it can not be read
+static struct dir_listing* read_listing(const char* path)
+{
+	struct dir_listing* l;
+	struct dirent* dirent;
+	struct stat st;
+	int capacity = 16;
+	DIR* dir = opendir(path);
+	if(dir == NULL){
+		return NULL;
+	}
+	if(fstat(dirfd(dir), &st) != 0){
+		closedir(dir);
+		return NULL;
+	}
+	for(l = listings; l; l = l->next){
+		if(strcmp(l->path, path) == 0 && is_same_dir(l, &st)){
+			closedir(dir);
+			return l;
+		}
+	}
+	if(!is_arena_ready){
+		arena_create(&listing_arena);
+		is_arena_ready = 1;
+	}
+	l = (struct dir_listing*)malloc(sizeof(struct dir_listing));
+	l->path = arena_strdup(&listing_arena, path, strlen(path));
+	l->dev = st.st_dev;
+	l->ino = st.st_ino;
+	l->mtime = st.st_mtim;
+	l->count = 0;
+	l->names = (char**)malloc(capacity * sizeof(char*));
+	while((dirent = readdir(dir)) != NULL){
+		const char* name = dirent->d_name;
+		if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0){
+			continue;
+		}
+		if(l->count == capacity){
+			capacity *= 2;
+			l->names = (char**)realloc(l->names,
+				capacity * sizeof(char*));
+		}
+		l->names[l->count++] = arena_strdup(&listing_arena, name,
+			strlen(name));
+	}
+	closedir(dir);
+	l->next = listings;
+	listings = l;
+	return l;
+}
+
+//the end of [...] starting at p, NULL if it is not closed
+static const char* bracket_end(const char* p)
+{
+	p++;
+	if(*p == '!' || *p == '^'){
+		p++;
+	}
+	//] right after [ or [! is a member
+	if(*p == ']'){
+		p++;
+	}
+	for(; *p && *p != '/'; p++){
+		if(*p == '\\' && p[1]){
+			p++;
+		}else if(*p == ']'){
+			return p;
+		}
+	}
+	return NULL;
+}
+
+bool has_glob(const char* pattern)
+{
+	const char* p;
+	for(p = pattern; *p; p++){
+		if(*p == '\\' && p[1]){
+			p++;
+		}else if(*p == '*' || *p == '?' ||
+			(*p == '[' && bracket_end(p))){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//c is in the bracket expression from p to end
+static bool bracket_match(const char* p, const char* end, char c)
+{
+	bool is_negated = *p == '!' || *p == '^';
+	bool is_member = 0;
+	if(is_negated){
+		p++;
+	}
+	while(p < end){
+		char from = *p++;
+		char to;
+		if(from == '\\' && p < end){
+			from = *p++;
+		}
+		to = from;
+		if(p + 1 < end && *p == '-'){
+			to = p[1];
+			p += 2;
+			if(to == '\\' && p < end){
+				to = *p++;
+			}
+		}
+		if((unsigned char)c >= (unsigned char)from &&
+			(unsigned char)c <= (unsigned char)to){
+			is_member = 1;
+		}
+	}
+	return is_member != is_negated;
+}
+
+//iterative matching with a return to the last *: it is only moved one
+//byte further, so the time is O(pattern * name) at most
+bool glob_match(const char* pattern, const char* name)
+{
+	const char* p = pattern;
+	const char* n = name;
+	const char* star = NULL;
+	const char* star_n = NULL;
+	while(*n){
+		const char* end;
+		if(*p == '*'){
+			star = ++p;
+			star_n = n;
+			continue;
+		}
+		if(*p == '?'){
+			p++;
+			n++;
+			continue;
+		}
+		if(*p == '[' && (end = bracket_end(p)) != NULL){
+			if(bracket_match(p + 1, end, *n)){
+				p = end + 1;
+				n++;
+				continue;
+			}
+		}else if(*p == '\\' && p[1] && p[1] == *n){
+			p += 2;
+			n++;
+			continue;
+		}else if(*p && *p != '\\' && *p == *n){
+			p++;
+			n++;
+			continue;
+		}
+		if(star == NULL){
+			return 0;
+		}
+		p = star;
+		n = ++star_n;
+	}
+	while(*p == '*'){
+		p++;
+	}
+	return *p == 0;
+}
+
+static void add_match(struct matches* m, const char* path, int len)
+{
+	if(m->count == m->capacity){
+		m->capacity = m->capacity ? m->capacity * 2 : 16;
+		m->paths = (char**)realloc(m->paths,
+			(m->capacity + 1) * sizeof(char*));
+	}
+	m->paths[m->count++] = strndup(path, len);
+}
+
+//append a component without active characters, only unescaped
+static void append_unescaped(struct buffer* path, const char* p, int len)
+{
+	int i;
+	for(i = 0; i < len; i++){
+		if(p[i] == '\\' && i + 1 < len){
+			i++;
+		}
+		insert_buffer(path, p[i]);
+	}
+}
+
+//path holds the matched directories with a trailing /, rest is the
+//pattern of the next components
+static void glob_dir(struct matches* m, struct buffer* path,
+	const char* rest)
+{
+	const char* slash = strchr(rest, '/');
+	int len = slash ? slash - rest : (int)strlen(rest);
+	int pos = path->pos;
+	struct dir_listing* l;
+	struct stat st;
+	char component[len + 1];
+	int i;
+	if(*rest == 0){
+		//a pattern with a trailing / matches only directories
+		insert_buffer(path, 0);
+		if(stat(path->array, &st) == 0 && S_ISDIR(st.st_mode)){
+			add_match(m, path->array, pos);
+		}
+		path->pos = pos;
+		return;
+	}
+	memcpy(component, rest, len);
+	component[len] = 0;
+	if(!has_glob(component)){
+		append_unescaped(path, component, len);
+		if(slash){
+			insert_buffer(path, '/');
+			glob_dir(m, path, slash + 1);
+		}else{
+			insert_buffer(path, 0);
+			if(lstat(path->array, &st) == 0){
+				add_match(m, path->array, path->pos - 1);
+			}
+		}
+		path->pos = pos;
+		return;
+	}
+	insert_buffer(path, 0);
+	l = read_listing(pos == 0 ? "." : path->array);
+	path->pos = pos;
+	for(i = 0; l && i < l->count; i++){
+		const char* name = l->names[i];
+		if(name[0] == '.' && component[0] != '.' &&
+			!(component[0] == '\\' && component[1] == '.')){
+			continue;
+		}
+		if(!glob_match(component, name)){
+			continue;
+		}
+		append_buffer(path, name, strlen(name));
+		if(slash){
+			insert_buffer(path, '/');
+			glob_dir(m, path, slash + 1);
+		}else{
+			add_match(m, path->array, path->pos);
+		}
+		path->pos = pos;
+	}
+}
+
+static int compare_paths(const void* a, const void* b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+char** glob_paths(const char* pattern, int* count)
+{
+	struct matches m = {NULL, 0, 0};
+	struct buffer* path = create_buffer(256);
+	//the directory listing is per component, so // is one /
+	if(*pattern == '/'){
+		insert_buffer(path, '/');
+		while(*pattern == '/'){
+			pattern++;
+		}
+	}
+	glob_dir(&m, path, pattern);
+	free_buffer(path);
+	*count = m.count;
+	if(m.count == 0){
+		return NULL;
+	}
+	qsort(m.paths, m.count, sizeof(char*), compare_paths);
+	m.paths[m.count] = NULL;
+	return m.paths;
+}
@@ -0,0 +1,24 @@
+#ifndef PATHGLOB_H
+#define PATHGLOB_H
+
+#include <stdbool.h>
+
+//pathname expansion. In patterns *, ? and [...] are active, a byte
+//after \ is literal: quoted parts of a word come escaped this way
+
+//true if the pattern has an active *, ? or a complete [...]
+bool has_glob(const char* pattern);
+
+//match a name against a pattern of one path component
+bool glob_match(const char* pattern, const char* name);
+
+//paths, which match the pattern, sorted, malloc'ed as the array
+//itself, NULL if there are none. Names starting with . are matched
+//only by a pattern with a literal . there
+char** glob_paths(const char* pattern, int* count);
+
+//directory listings are read once per command line, a listing is
+//read again only if the directory has changed since
+void glob_cache_clear();
+
+#endif
@@ -0,0 +1,223 @@
+#include "pathhash.h"
+#include "vars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#define PATH_HASH_START_SIZE 64
+
+struct path_entry{
+	char* name;
+	char* path;
+	unsigned hash;
+	int hits;
+	struct path_entry* next;
+};
+
+//chained hash table, the bucket count is a power of 2 and is
+//doubled when there are more entries than buckets
+static struct path_entry** buckets = NULL;
+static int bucket_count = 0;
+static int entry_count = 0;
+//PATH, which the cached paths were found with
+static char* cached_path_var = NULL;
+
+static unsigned hash_name(const char* name)
+{
+	unsigned h = 2166136261u;
+	for(; *name; name++){
+		h = (h ^ (unsigned char)*name) * 16777619u;
+	}
+	return h;
+}
+
+void path_clear()
+{
+	int i;
+	for(i = 0; i < bucket_count; i++){
+		while(buckets[i]){
+			struct path_entry* e = buckets[i];
+			buckets[i] = e->next;
+			free(e->name);
+			free(e->path);
+			free(e);
+		}
+	}
+	entry_count = 0;
+	free(cached_path_var);
+	cached_path_var = NULL;
+}
+
+static void check_path_var()
+{
+	const char* var = var_get("PATH");
+	if(var == NULL){
+		var = "";
+	}
+	if(cached_path_var && strcmp(cached_path_var, var) == 0){
+		return;
+	}
+	path_clear();
+	cached_path_var = strdup(var);
+}
+
+static struct path_entry** find_entry(const char* name, unsigned h)
+{
+	struct path_entry** p;
+	if(bucket_count == 0){
+		return NULL;
+	}
+	p = &buckets[h & (bucket_count - 1)];
+	while(*p && ((*p)->hash != h || strcmp((*p)->name, name) != 0)){
+		p = &(*p)->next;
+	}
+	return p;
+}
+
+static void grow_buckets()
+{
+	int new_count = bucket_count ? bucket_count * 2 : PATH_HASH_START_SIZE;
+	struct path_entry** new_buckets = (struct path_entry**)calloc(
+		new_count, sizeof(struct path_entry*));
+	int i;
+	if(new_buckets == NULL){
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	for(i = 0; i < bucket_count; i++){
+		while(buckets[i]){
+			struct path_entry* e = buckets[i];
+			buckets[i] = e->next;
+			e->next = new_buckets[e->hash & (new_count - 1)];
+			new_buckets[e->hash & (new_count - 1)] = e;
+		}
+	}
+	free(buckets);
+	buckets = new_buckets;
+	bucket_count = new_count;
+}
+
+static bool is_executable(const char* path)
+{
+	struct stat st;
+	return stat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+		access(path, X_OK) == 0;
+}
+
+//walk PATH as execvp does, the result is malloc'ed
+static char* search_path(const char* name)
+{
+	const char* dir = cached_path_var;
+	int name_len = strlen(name);
+	while(1){
+		const char* end = strchr(dir, ':');
+		int dir_len = end ? end - dir : (int)strlen(dir);
+		char* path = (char*)malloc(dir_len + name_len + 2);
+		//an empty entry is the current directory
+		if(dir_len == 0){
+			path[0] = '.';
+			dir_len = 1;
+		}else{
+			memcpy(path, dir, dir_len);
+		}
+		path[dir_len] = '/';
+		memcpy(path + dir_len + 1, name, name_len + 1);
+		if(is_executable(path)){
+			return path;
+		}
+		free(path);
+		if(end == NULL){
+			return NULL;
+		}
+		dir = end + 1;
+	}
+}
+
+const char* path_lookup(const char* name)
+{
+	unsigned h;
+	struct path_entry** p;
+	struct path_entry* e;
+	char* path;
+	if(strchr(name, '/')){
+		return name;
+	}
+	check_path_var();
+	h = hash_name(name);
+	p = find_entry(name, h);
+	if(p && *p){
+		(*p)->hits++;
+		return (*p)->path;
+	}
+	path = search_path(name);
+	if(path == NULL){
+		return NULL;
+	}
+	if(entry_count >= bucket_count){
+		grow_buckets();
+	}
+	e = (struct path_entry*)malloc(sizeof(struct path_entry));
+	e->name = strdup(name);
+	e->path = path;
+	e->hash = h;
+	e->hits = 1;
+	e->next = buckets[h & (bucket_count - 1)];
+	buckets[h & (bucket_count - 1)] = e;
+	entry_count++;
+	return path;
+}
+
+void path_forget(const char* name)
+{
+	struct path_entry** p = find_entry(name, hash_name(name));
+	struct path_entry* e;
+	if(p == NULL || *p == NULL){
+		return;
+	}
+	e = *p;
+	*p = e->next;
+	free(e->name);
+	free(e->path);
+	free(e);
+	entry_count--;
+}
+
+int builtin_hash(int argc, char** argv)
+{
+	int exit_code = 0;
+	int i;
+	check_path_var();
+	if(argc == 1){
+		if(entry_count == 0){
+			printf("hash: hash table empty\n");
+			return 0;
+		}
+		printf("hits\tcommand\n");
+		for(i = 0; i < bucket_count; i++){
+			struct path_entry* e;
+			for(e = buckets[i]; e; e = e->next){
+				printf("%4d\t%s\n", e->hits, e->path);
+			}
+		}
+		return 0;
+	}
+	for(i = 1; i < argc; i++){
+		if(strcmp(argv[i], "-r") == 0){
+			path_clear();
+			check_path_var();
+			continue;
+		}
+		path_forget(argv[i]);
+		if(path_lookup(argv[i]) == NULL){
+			fprintf(stderr, "hash: %s: not found\n", argv[i]);
+			exit_code = 1;
+		}else if(!strchr(argv[i], '/')){
+			//hash adds a command without using it
+			(*find_entry(argv[i], hash_name(argv[i])))->hits = 0;
+		}
+	}
+	return exit_code;
+}
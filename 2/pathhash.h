@@ -0,0 +1,20 @@
+#ifndef PATHHASH_H
+#define PATHHASH_H
+
+//cache of command name -> full path of the executable, as the hash
+//builtin of bash. It is dropped, when PATH changes
+
+//full path of a command, NULL if it is not found. A name with '/' is
+//returned as is. The result is valid until the next call
+const char* path_lookup(const char* name);
+
+//drop a command, when its cached path has disappeared
+void path_forget(const char* name);
+
+void path_clear();
+
+//hash [-r] [name...]: without arguments print the cache, -r clears
+//it, names are looked up and added
+int builtin_hash(int argc, char** argv);
+
+#endif
@@ -0,0 +1,231 @@
+#include "profile.h"
+#include "stream.h"
+#include "vars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+//the profile file is opened once and reopened, when the variable is
+//changed. O_APPEND and one write() per record keep records of
+//concurrent shells whole
+static char* profile_path = NULL;
+static int profile_fd = -1;
+
+static int get_profile_fd()
+{
+	const char* path = var_get(PROFILE_VAR);
+	if(path == NULL || path[0] == 0){
+		return -1;
+	}
+	if(profile_path && strcmp(profile_path, path) == 0){
+		return profile_fd;
+	}
+	if(profile_fd != -1){
+		close(profile_fd);
+	}
+	free(profile_path);
+	profile_path = strdup(path);
+	profile_fd = open(path, O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0644);
+	if(profile_fd == -1){
+		perror(path);
+	}
+	return profile_fd;
+}
+
+bool profile_is_wanted(struct node* n)
+{
+	return n->is_timed || get_profile_fd() != -1;
+}
+
+static double timeval_sec(struct timeval* tv)
+{
+	return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static void timeval_sub(struct timeval* a, struct timeval* b,
+	struct timeval* res)
+{
+	res->tv_sec = a->tv_sec - b->tv_sec;
+	res->tv_usec = a->tv_usec - b->tv_usec;
+	if(res->tv_usec < 0){
+		res->tv_sec--;
+		res->tv_usec += 1000000;
+	}
+}
+
+void rusage_diff(struct rusage* before, struct rusage* res)
+{
+	struct rusage now;
+	getrusage(RUSAGE_SELF, &now);
+	memset(res, 0, sizeof(*res));
+	timeval_sub(&now.ru_utime, &before->ru_utime, &res->ru_utime);
+	timeval_sub(&now.ru_stime, &before->ru_stime, &res->ru_stime);
+	res->ru_maxrss = now.ru_maxrss;
+	res->ru_nvcsw = now.ru_nvcsw - before->ru_nvcsw;
+	res->ru_nivcsw = now.ru_nivcsw - before->ru_nivcsw;
+}
+
+struct usage_total{
+	double real;
+	double user;
+	double sys;
+	long maxrss;
+	long nvcsw;
+	long nivcsw;
+};
+
+static void sum_usages(struct stage_usage* usages, int count,
+	struct usage_total* total)
+{
+	int i;
+	for(i = 0; i < count; i++){
+		struct rusage* ru = &usages[i].ru;
+		total->user += timeval_sec(&ru->ru_utime);
+		total->sys += timeval_sec(&ru->ru_stime);
+		if(ru->ru_maxrss > total->maxrss){
+			total->maxrss = ru->ru_maxrss;
+		}
+		total->nvcsw += ru->ru_nvcsw;
+		total->nivcsw += ru->ru_nivcsw;
+	}
+}
+
+static void print_time(const char* name, double sec)
+{
+	int min = (int)(sec / 60);
+	fprintf(stderr, "%s\t%dm%.3fs\n", name, min, sec - min * 60);
+}
+
+static void print_report(struct usage_total* total)
+{
+	fflush(stdout);
+	fprintf(stderr, "\n");
+	print_time("real", total->real);
+	print_time("user", total->user);
+	print_time("sys", total->sys);
+	fprintf(stderr, "maxrss\t%ldKB\n", total->maxrss);
+	fprintf(stderr, "csw\t%ld voluntary, %ld involuntary\n",
+		total->nvcsw, total->nivcsw);
+}
+
+static void append_json_string(struct buffer* buf, const char* str)
+{
+	insert_buffer(buf, '"');
+	for(; *str; str++){
+		unsigned char c = *str;
+		if(c == '"' || c == '\\'){
+			insert_buffer(buf, '\\');
+			insert_buffer(buf, c);
+		}else if(c < 0x20){
+			char esc[8];
+			snprintf(esc, sizeof(esc), "\\u%04x", c);
+			append_buffer(buf, esc, 6);
+		}else{
+			insert_buffer(buf, c);
+		}
+	}
+	insert_buffer(buf, '"');
+}
+
+static void append_format(struct buffer* buf, const char* fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static void append_format(struct buffer* buf, const char* fmt, ...)
+{
+	va_list ap;
+	va_list again;
+	int n;
+	reserve_buffer(buf, 128);
+	va_start(ap, fmt);
+	va_copy(again, ap);
+	n = vsnprintf(buf->array + buf->pos, buf->len - buf->pos, fmt, ap);
+	//a longer text is cut by the first try, which returns its length,
+	//then the buffer grows to it and the text is printed again
+	if(n >= buf->len - buf->pos){
+		reserve_buffer(buf, n + 1);
+		vsnprintf(buf->array + buf->pos, buf->len - buf->pos, fmt, again);
+	}
+	va_end(again);
+	va_end(ap);
+	if(n > 0){
+		buf->pos += n;
+	}
+}
+
+static void append_usage(struct buffer* buf, double user, double sys,
+	long maxrss, long nvcsw, long nivcsw)
+{
+	append_format(buf, "\"user\":%.6f,\"sys\":%.6f,\"maxrss_kb\":%ld,"
+		"\"nvcsw\":%ld,\"nivcsw\":%ld", user, sys, maxrss, nvcsw, nivcsw);
+}
+
+//{"cmd":..., "time":..., "real":..., usage, "exit":...,
+//"stages":[{"argv0":..., "pid":..., usage, "exit":...}, ...]}
+static void write_record(int fd, struct node* n, struct node** stages,
+	struct stage_usage* usages, int count, struct usage_total* total)
+{
+	struct buffer* buf = create_buffer(512);
+	struct buffer* text = create_buffer(128);
+	struct timeval now;
+	int i;
+	format_node(n, text);
+	insert_buffer(text, 0);
+	gettimeofday(&now, NULL);
+	append_buffer(buf, "{\"cmd\":", 7);
+	append_json_string(buf, text->array);
+	append_format(buf, ",\"time\":%.6f,\"real\":%.6f,",
+		timeval_sec(&now), total->real);
+	append_usage(buf, total->user, total->sys, total->maxrss,
+		total->nvcsw, total->nivcsw);
+	append_format(buf, ",\"exit\":%d,\"stages\":[",
+		usages[count - 1].exit_code);
+	for(i = 0; i < count; i++){
+		struct rusage* ru = &usages[i].ru;
+		const char* argv0 = "";
+		if(stages[i]->type == NODE_SUBSHELL){
+			argv0 = "(";
+		}else if(stages[i]->type == NODE_GROUP){
+			argv0 = "{";
+		}else if(stages[i]->command.argc > 0){
+			argv0 = stages[i]->command.argv[0];
+		}
+		if(i > 0){
+			insert_buffer(buf, ',');
+		}
+		append_buffer(buf, "{\"argv0\":", 9);
+		append_json_string(buf, argv0);
+		append_format(buf, ",\"pid\":%d,", (int)usages[i].pid);
+		append_usage(buf, timeval_sec(&ru->ru_utime),
+			timeval_sec(&ru->ru_stime), ru->ru_maxrss, ru->ru_nvcsw,
+			ru->ru_nivcsw);
+		append_format(buf, ",\"exit\":%d}", usages[i].exit_code);
+	}
+	append_buffer(buf, "]}\n", 3);
+	write_all(fd, buf->array, buf->pos);
+	free_buffer(text);
+	free_buffer(buf);
+}
+
+void profile_report(struct node* n, struct node** stages,
+	struct stage_usage* usages, int count, struct timespec* start)
+{
+	struct usage_total total;
+	struct timespec end;
+	int fd;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	memset(&total, 0, sizeof(total));
+	total.real = end.tv_sec - start->tv_sec +
+		(end.tv_nsec - start->tv_nsec) / 1e9;
+	sum_usages(usages, count, &total);
+	if(n->is_timed){
+		print_report(&total);
+	}
+	fd = get_profile_fd();
+	if(fd != -1){
+		write_record(fd, n, stages, usages, count, &total);
+	}
+}
@@ -0,0 +1,33 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "parser.h"
+
+//name of the variable with a file path, a JSON line is appended to
+//the file for each executed pipeline
+#define PROFILE_VAR "SHELL_PROFILE"
+
+//usage of one pipeline stage, from wait4() or, for a builtin in the
+//shell, a getrusage() difference
+struct stage_usage{
+	pid_t pid;
+	int exit_code;
+	struct rusage ru;
+};
+
+//a pipeline must be measured, if it is timed or the profile is on
+bool profile_is_wanted(struct node* n);
+
+//a pipeline is finished: print a time report for the time prefix and
+//write a profile record. start is CLOCK_MONOTONIC
+void profile_report(struct node* n, struct node** stages,
+	struct stage_usage* usages, int count, struct timespec* start);
+
+//resource usage of the shell itself since before
+void rusage_diff(struct rusage* before, struct rusage* res);
+
+#endif
@@ -0,0 +1,731 @@
+#include "script.h"
+#include "arena.h"
+#include "lexer.h"
+#include "parser.h"
+#include "exec.h"
+#include "jobs.h"
+#include "vars.h"
+#include "pathglob.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//a new format must have a new magic, old cache files are then
+//ignored
+#define SCRIPT_CACHE_MAGIC "shast\0\0\10"
+#define SCRIPT_CACHE_MAGIC_SIZE 8
+
+//one line of a script: a parsed line or an error to report, when
+//the execution comes to it
+struct script_line{
+	struct node* root;
+	const char* error;
+	struct script_line* next;
+};
+
+struct script{
+	struct arena arena;
+	struct script_line* first;
+	struct script_line* last;
+	int line_count;
+};
+
+static struct script_line* add_line(struct script* s, struct node* root,
+	const char* error)
+{
+	struct script_line* line = (struct script_line*)arena_alloc(
+		&s->arena, sizeof(struct script_line));
+	line->root = root;
+	line->error = error;
+	line->next = NULL;
+	if(s->last){
+		s->last->next = line;
+	}else{
+		s->first = line;
+	}
+	s->last = line;
+	s->line_count++;
+	return line;
+}
+
+static void parse_script_line(struct token* tokens, void* ctx)
+{
+	struct script* s = (struct script*)ctx;
+	const char* error;
+	struct node* root = parse_line(tokens, &s->arena, &error);
+	if(root || error){
+		add_line(s, root, error);
+	}
+}
+
+static void parse_script(struct script* s, const char* text, size_t size)
+{
+	struct lexer lx;
+	const char* error;
+	lexer_create(&lx, &s->arena, parse_script_line, s);
+	while(size > 0){
+		int n = size > (1 << 30) ? (1 << 30) : (int)size;
+		lexer_feed(&lx, text, n);
+		text += n;
+		size -= n;
+	}
+	error = lexer_finish(&lx);
+	if(error){
+		add_line(s, NULL, error);
+	}
+	lexer_destroy(&lx);
+}
+
+//FNV-1a, h is the hash of the text before
+static uint64_t hash_more(uint64_t h, const char* text, size_t size)
+{
+	size_t i;
+	for(i = 0; i < size; i++){
+		h = (h ^ (unsigned char)text[i]) * 1099511628211ull;
+	}
+	return h;
+}
+
+static uint64_t hash_text(const char* text, size_t size)
+{
+	return hash_more(14695981039346656037ull, text, size);
+}
+
+//cache file format, numbers are varints: 7 bits per byte, the high
+//bit is set in all bytes but the last one:
+//
+//file      := magic uint64_t(hash) uint64_t(size) uint64_t(checksum)
+//             string_count (len bytes 0)* line_count line*
+//line      := 0 node | 1 string_id
+//node      := type (command | pipeline | pair | node | group)
+//command   := is_timed argc assign_count string_id* has_expansions
+//             expansions* redirects
+//pipeline  := is_timed count node*
+//pair      := node has_right node?
+//group     := is_timed node redirects
+//redirects := count (type string_id expansions)*
+//expansions:= count (type offset is_quoted string_id?)*
+//
+//type of a node is enum node_type: a pair is and, or or a sequence,
+//the plain node is the child of a background item, a group is a
+//subshell or a { } group. The first assign_count words of a command
+//are assignments. With has_expansions each word has its expansions,
+//a redirect path always has them. An expansion has the string of its
+//source text, but a glob mark, which only tells that the character
+//at offset is an unquoted *, ?, [ or ], has none.
+//
+//The checksum is the hash of the rest of the file after it, so a
+//damaged file is ignored before it is parsed. Still every read is
+//checked: ids, counts and types are in range, assignments are
+//NAME=value. Chains of pairs are right-deep, they are written and
+//read in a loop.
+//Words repeat a lot in scripts, so each one is stored once in the
+//string table. Strings of the loaded AST point into the mapped file
+
+//string -> id of the string table, open addressing
+struct string_table{
+	const char** strings;
+	int* ids;
+	int size;
+	int count;
+};
+
+static unsigned hash_string(const char* str)
+{
+	unsigned h = 2166136261u;
+	for(; *str; str++){
+		h = (h ^ (unsigned char)*str) * 16777619u;
+	}
+	return h;
+}
+
+static void string_table_create(struct string_table* t)
+{
+	t->size = 1024;
+	t->count = 0;
+	t->strings = (const char**)calloc(t->size, sizeof(char*));
+	t->ids = (int*)malloc(t->size * sizeof(int));
+}
+
+static void string_table_destroy(struct string_table* t)
+{
+	free(t->strings);
+	free(t->ids);
+}
+
+static int* string_slot(struct string_table* t, const char* str)
+{
+	unsigned i = hash_string(str) & (t->size - 1);
+	while(t->strings[i] && strcmp(t->strings[i], str) != 0){
+		i = (i + 1) & (t->size - 1);
+	}
+	t->strings[i] = str;
+	return &t->ids[i];
+}
+
+//id of a string, new strings get the next id and are appended to
+//the list of all strings in order
+static int string_id(struct string_table* t, const char* str,
+	struct buffer* list)
+{
+	unsigned i = hash_string(str) & (t->size - 1);
+	int* id;
+	while(t->strings[i] && strcmp(t->strings[i], str) != 0){
+		i = (i + 1) & (t->size - 1);
+	}
+	if(t->strings[i]){
+		return t->ids[i];
+	}
+	if(2 * (t->count + 1) > t->size){
+		struct string_table bigger;
+		int k;
+		bigger.size = t->size * 2;
+		bigger.count = t->count;
+		bigger.strings = (const char**)calloc(bigger.size, sizeof(char*));
+		bigger.ids = (int*)malloc(bigger.size * sizeof(int));
+		for(k = 0; k < t->size; k++){
+			if(t->strings[k]){
+				*string_slot(&bigger, t->strings[k]) = t->ids[k];
+			}
+		}
+		string_table_destroy(t);
+		*t = bigger;
+	}
+	id = string_slot(t, str);
+	*id = t->count++;
+	append_buffer(list, (const char*)&str, sizeof(str));
+	return *id;
+}
+
+static void write_varint(struct buffer* buf, uint64_t v)
+{
+	while(v >= 0x80){
+		insert_buffer(buf, (char)(v | 0x80));
+		v >>= 7;
+	}
+	insert_buffer(buf, (char)v);
+}
+
+struct writer{
+	struct buffer* buf;
+	struct string_table strings;
+	//const char* of each string in order of ids
+	struct buffer* list;
+};
+
+static void write_string(struct writer* w, const char* str)
+{
+	write_varint(w->buf, string_id(&w->strings, str, w->list));
+}
+
+static void write_expansions(struct writer* w, struct expansion* e)
+{
+	struct expansion* i;
+	uint32_t count = 0;
+	for(i = e; i; i = i->next){
+		count++;
+	}
+	write_varint(w->buf, count);
+	for(; e; e = e->next){
+		write_varint(w->buf, e->type);
+		write_varint(w->buf, e->offset);
+		write_varint(w->buf, e->is_quoted);
+		if(e->type != EXPANSION_GLOB){
+			write_string(w, e->text);
+		}
+	}
+}
+
+static void write_redirects(struct writer* w, struct redirect* r)
+{
+	struct redirect* i;
+	uint32_t count = 0;
+	for(i = r; i; i = i->next){
+		count++;
+	}
+	write_varint(w->buf, count);
+	for(; r; r = r->next){
+		write_varint(w->buf, r->type);
+		write_string(w, r->path);
+		write_expansions(w, r->expansions);
+	}
+}
+
+static void write_node(struct writer* w, struct node* n)
+{
+	int i;
+	while(1){
+		write_varint(w->buf, n->type);
+		switch(n->type){
+		case NODE_COMMAND:
+			write_varint(w->buf, n->is_timed);
+			write_varint(w->buf, n->command.argc);
+			write_varint(w->buf, n->command.assign_count);
+			for(i = 0; i < n->command.argc; i++){
+				write_string(w, n->command.argv[i]);
+			}
+			write_varint(w->buf, n->command.expansions != NULL);
+			for(i = 0; n->command.expansions && i < n->command.argc; i++){
+				write_expansions(w, n->command.expansions[i]);
+			}
+			write_redirects(w, n->command.redirects);
+			break;
+		case NODE_PIPELINE:
+			write_varint(w->buf, n->is_timed);
+			write_varint(w->buf, n->pipeline.count);
+			for(i = 0; i < n->pipeline.count; i++){
+				write_node(w, n->pipeline.stages[i]);
+			}
+			break;
+		case NODE_AND:
+		case NODE_OR:
+		case NODE_SEQUENCE:
+			//chains are right-deep, the loop goes on with the right
+			//node instead of a recursive call, the bytes are the same
+			write_node(w, n->pair.left);
+			write_varint(w->buf, n->pair.right != NULL);
+			if(n->pair.right){
+				n = n->pair.right;
+				continue;
+			}
+			break;
+		case NODE_BACKGROUND:
+			write_node(w, n->child);
+			break;
+		case NODE_SUBSHELL:
+		case NODE_GROUP:
+			write_varint(w->buf, n->is_timed);
+			write_node(w, n->group.body);
+			write_redirects(w, n->group.redirects);
+			break;
+		}
+		break;
+	}
+}
+
+struct reader{
+	const unsigned char* p;
+	const unsigned char* end;
+	struct arena* arena;
+	char** strings;
+	uint32_t string_count;
+	bool is_error;
+};
+
+static uint32_t read_varint(struct reader* r)
+{
+	uint64_t v = 0;
+	int shift = 0;
+	while(r->p < r->end && shift < 35){
+		unsigned char c = *r->p++;
+		v |= (uint64_t)(c & 0x7f) << shift;
+		if(!(c & 0x80)){
+			if(v > UINT32_MAX){
+				break;
+			}
+			return v;
+		}
+		shift += 7;
+	}
+	r->is_error = 1;
+	return 0;
+}
+
+static char* read_string(struct reader* r)
+{
+	uint32_t id = read_varint(r);
+	if(id >= r->string_count){
+		r->is_error = 1;
+		return NULL;
+	}
+	return r->strings[id];
+}
+
+//counts are checked against the rest of the file, each item takes at
+//least a byte, so a broken file can not make a huge allocation
+static uint32_t read_count(struct reader* r)
+{
+	uint32_t count = read_varint(r);
+	if(count > (uint64_t)(r->end - r->p)){
+		r->is_error = 1;
+		return 0;
+	}
+	return count;
+}
+
+//offsets must grow and stay inside the word
+static struct expansion* read_expansions(struct reader* r,
+	const char* word)
+{
+	struct expansion* first = NULL;
+	struct expansion** last = &first;
+	uint32_t count = read_count(r);
+	uint32_t len = word ? strlen(word) : 0;
+	uint32_t offset = 0;
+	uint32_t i;
+	for(i = 0; i < count && !r->is_error; i++){
+		struct expansion* e = (struct expansion*)arena_alloc(r->arena,
+			sizeof(struct expansion));
+		e->type = read_varint(r);
+		e->offset = read_varint(r);
+		e->is_quoted = read_varint(r) != 0;
+		e->text = e->type == EXPANSION_GLOB ? NULL : read_string(r);
+		e->next = NULL;
+		if((e->type != EXPANSION_COMMAND &&
+			e->type != EXPANSION_VARIABLE &&
+			e->type != EXPANSION_GLOB) || (uint32_t)e->offset < offset ||
+			(uint32_t)e->offset > len ||
+			(e->type == EXPANSION_GLOB && (uint32_t)e->offset == len)){
+			r->is_error = 1;
+		}
+		offset = e->offset;
+		*last = e;
+		last = &e->next;
+	}
+	return first;
+}
+
+static struct redirect* read_redirects(struct reader* r)
+{
+	struct redirect* first = NULL;
+	struct redirect** last = &first;
+	uint32_t count = read_count(r);
+	uint32_t i;
+	for(i = 0; i < count && !r->is_error; i++){
+		struct redirect* rd = (struct redirect*)arena_alloc(
+			r->arena, sizeof(struct redirect));
+		rd->type = read_varint(r);
+		if((uint32_t)rd->type > REDIRECT_HERESTRING){
+			r->is_error = 1;
+			return first;
+		}
+		rd->path = read_string(r);
+		rd->expansions = read_expansions(r, rd->path);
+		rd->next = NULL;
+		*last = rd;
+		last = &rd->next;
+	}
+	return first;
+}
+
+static struct node* read_node(struct reader* r, int depth)
+{
+	struct node* first = NULL;
+	struct node** last = &first;
+	struct node* n;
+	uint32_t count;
+	uint32_t i;
+	if(depth > 10000){
+		r->is_error = 1;
+		return NULL;
+	}
+	while(1){
+		n = (struct node*)arena_alloc(r->arena, sizeof(struct node));
+		*last = n;
+		memset(n, 0, sizeof(struct node));
+		n->type = read_varint(r);
+		switch(n->type){
+		case NODE_COMMAND:
+			n->is_timed = read_varint(r) != 0;
+			n->command.argc = count = read_count(r);
+			n->command.assign_count = read_varint(r);
+			if((uint32_t)n->command.assign_count > count){
+				r->is_error = 1;
+				return NULL;
+			}
+			n->command.argv = (char**)arena_alloc(r->arena,
+				(count + 1) * sizeof(char*));
+			for(i = 0; i < count; i++){
+				n->command.argv[i] = read_string(r);
+			}
+			n->command.argv[count] = NULL;
+			for(i = 0; i < (uint32_t)n->command.assign_count &&
+				!r->is_error; i++){
+				const char* eq = strchr(n->command.argv[i], '=');
+				if(eq == NULL || !is_var_name(n->command.argv[i],
+					eq - n->command.argv[i])){
+					r->is_error = 1;
+				}
+			}
+			if(read_varint(r)){
+				n->command.expansions = (struct expansion**)arena_alloc(
+					r->arena, count * sizeof(struct expansion*));
+				for(i = 0; i < count && !r->is_error; i++){
+					n->command.expansions[i] = read_expansions(r,
+						n->command.argv[i]);
+				}
+			}
+			n->command.redirects = read_redirects(r);
+			break;
+		case NODE_PIPELINE:
+			n->is_timed = read_varint(r) != 0;
+			n->pipeline.count = count = read_count(r);
+			if(count < 2){
+				r->is_error = 1;
+				return NULL;
+			}
+			n->pipeline.stages = (struct node**)arena_alloc(r->arena,
+				count * sizeof(struct node*));
+			for(i = 0; i < count && !r->is_error; i++){
+				n->pipeline.stages[i] = read_node(r, depth + 1);
+				if(n->pipeline.stages[i] &&
+					n->pipeline.stages[i]->type != NODE_COMMAND &&
+					n->pipeline.stages[i]->type != NODE_SUBSHELL &&
+					n->pipeline.stages[i]->type != NODE_GROUP){
+					r->is_error = 1;
+				}
+			}
+			break;
+		case NODE_AND:
+		case NODE_OR:
+		case NODE_SEQUENCE:
+			//the right node of a chain is read by the loop instead of
+			//a recursive call and does not count in the depth
+			n->pair.left = read_node(r, depth + 1);
+			if(read_varint(r) && !r->is_error){
+				last = &n->pair.right;
+				continue;
+			}else if(n->type != NODE_SEQUENCE){
+				r->is_error = 1;
+			}
+			break;
+		case NODE_BACKGROUND:
+			n->child = read_node(r, depth + 1);
+			break;
+		case NODE_SUBSHELL:
+		case NODE_GROUP:
+			n->is_timed = read_varint(r) != 0;
+			n->group.body = read_node(r, depth + 1);
+			n->group.redirects = read_redirects(r);
+			break;
+		default:
+			r->is_error = 1;
+		}
+		break;
+	}
+	return r->is_error ? NULL : first;
+}
+
+//string table of the file: each string is a varint length, bytes and
+//0, so it can be used in place
+static void read_strings(struct reader* r)
+{
+	uint32_t i;
+	r->string_count = read_count(r);
+	r->strings = (char**)arena_alloc(r->arena,
+		r->string_count * sizeof(char*) + 1);
+	for(i = 0; i < r->string_count && !r->is_error; i++){
+		uint32_t len = read_varint(r);
+		if(r->is_error || len >= (uint64_t)(r->end - r->p) ||
+			r->p[len] != 0){
+			r->is_error = 1;
+			return;
+		}
+		r->strings[i] = (char*)r->p;
+		r->p += len + 1;
+	}
+}
+
+//$XDG_CACHE_HOME/shell or ~/.cache/shell, NULL if there is no place.
+//The base directory is created too, if it does not exist, in both
+//cases, but not the ones above it
+static char* cache_path(uint64_t hash)
+{
+	const char* base = var_get("XDG_CACHE_HOME");
+	const char* home = var_get("HOME");
+	char dir[4096];
+	char* path;
+	if(base && base[0]){
+		snprintf(dir, sizeof(dir), "%s", base);
+	}else if(home && home[0]){
+		snprintf(dir, sizeof(dir), "%s/.cache", home);
+	}else{
+		return NULL;
+	}
+	if(mkdir(dir, 0700) != 0 && errno != EEXIST){
+		return NULL;
+	}
+	strncat(dir, "/shell", sizeof(dir) - strlen(dir) - 1);
+	if(mkdir(dir, 0700) != 0 && errno != EEXIST){
+		return NULL;
+	}
+	path = (char*)malloc(strlen(dir) + 32);
+	sprintf(path, "%s/%016llx.ast", dir, (unsigned long long)hash);
+	return path;
+}
+
+static bool load_cache(struct script* s, const char* path, uint64_t hash,
+	uint64_t size)
+{
+	struct reader r;
+	struct stat st;
+	char* map;
+	uint64_t cached_hash;
+	uint64_t cached_size;
+	uint64_t checksum;
+	uint32_t count;
+	uint32_t i;
+	int fd = open(path, O_RDONLY|O_CLOEXEC);
+	if(fd == -1){
+		return 0;
+	}
+	if(fstat(fd, &st) != 0 || st.st_size < SCRIPT_CACHE_MAGIC_SIZE + 24){
+		close(fd);
+		return 0;
+	}
+	//the mapping lives until the end, the AST points into it. The
+	//words are writable as ones of a parsed AST, the file is not
+	//changed by that
+	map = (char*)mmap(NULL, st.st_size, PROT_READ|PROT_WRITE,
+		MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED){
+		return 0;
+	}
+	memcpy(&cached_hash, map + SCRIPT_CACHE_MAGIC_SIZE, 8);
+	memcpy(&cached_size, map + SCRIPT_CACHE_MAGIC_SIZE + 8, 8);
+	memcpy(&checksum, map + SCRIPT_CACHE_MAGIC_SIZE + 16, 8);
+	r.p = (const unsigned char*)map + SCRIPT_CACHE_MAGIC_SIZE + 24;
+	r.end = (const unsigned char*)map + st.st_size;
+	r.arena = &s->arena;
+	r.is_error = memcmp(map, SCRIPT_CACHE_MAGIC,
+		SCRIPT_CACHE_MAGIC_SIZE) != 0 || cached_hash != hash ||
+		cached_size != size ||
+		hash_text((const char*)r.p, r.end - r.p) != checksum;
+	if(!r.is_error){
+		read_strings(&r);
+	}
+	count = read_varint(&r);
+	for(i = 0; i < count && !r.is_error; i++){
+		if(read_varint(&r) == 0){
+			add_line(s, read_node(&r, 0), NULL);
+		}else{
+			add_line(s, NULL, read_string(&r));
+		}
+	}
+	if(r.is_error || r.p != r.end){
+		munmap(map, st.st_size);
+		arena_reset(&s->arena);
+		s->first = NULL;
+		s->last = NULL;
+		s->line_count = 0;
+		return 0;
+	}
+	return 1;
+}
+
+//written into a temporary file and renamed, so concurrent runs never
+//see a partial cache file
+static void save_cache(struct script* s, const char* path, uint64_t hash,
+	uint64_t size)
+{
+	struct writer w;
+	struct buffer* head = create_buffer(4096);
+	struct buffer* strings_buf = create_buffer(4096);
+	struct script_line* line;
+	const char** strings;
+	char* tmp = (char*)malloc(strlen(path) + 32);
+	uint64_t checksum;
+	int fd;
+	int i;
+	w.buf = create_buffer(4096);
+	w.list = create_buffer(4096);
+	string_table_create(&w.strings);
+	write_varint(w.buf, s->line_count);
+	for(line = s->first; line; line = line->next){
+		write_varint(w.buf, line->root == NULL);
+		if(line->root){
+			write_node(&w, line->root);
+		}else{
+			write_string(&w, line->error);
+		}
+	}
+	append_buffer(head, SCRIPT_CACHE_MAGIC, SCRIPT_CACHE_MAGIC_SIZE);
+	append_buffer(head, (const char*)&hash, sizeof(hash));
+	append_buffer(head, (const char*)&size, sizeof(size));
+	write_varint(strings_buf, w.strings.count);
+	strings = (const char**)w.list->array;
+	for(i = 0; i < w.strings.count; i++){
+		int len = strlen(strings[i]);
+		write_varint(strings_buf, len);
+		append_buffer(strings_buf, strings[i], len + 1);
+	}
+	//the hash of the string table goes on over the lines, as if they
+	//were one buffer
+	checksum = hash_text(strings_buf->array, strings_buf->pos);
+	checksum = hash_more(checksum, w.buf->array, w.buf->pos);
+	append_buffer(head, (const char*)&checksum, sizeof(checksum));
+	append_buffer(head, strings_buf->array, strings_buf->pos);
+	sprintf(tmp, "%s.%d", path, (int)getpid());
+	fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0600);
+	if(fd != -1){
+		bool is_ok = write(fd, head->array, head->pos) == head->pos &&
+			write(fd, w.buf->array, w.buf->pos) == w.buf->pos;
+		close(fd);
+		if(!is_ok || rename(tmp, path) != 0){
+			unlink(tmp);
+		}
+	}
+	free(tmp);
+	string_table_destroy(&w.strings);
+	free_buffer(w.list);
+	free_buffer(w.buf);
+	free_buffer(strings_buf);
+	free_buffer(head);
+}
+
+int run_script(const char* path)
+{
+	struct script s;
+	struct script_line* line;
+	struct stat st;
+	char* text = NULL;
+	char* cache;
+	uint64_t hash;
+	int exit_code = 0;
+	int fd = open(path, O_RDONLY|O_CLOEXEC);
+	if(fd == -1 || fstat(fd, &st) != 0){
+		perror(path);
+		return 127;
+	}
+	if(st.st_size > 0){
+		text = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+			fd, 0);
+		if(text == MAP_FAILED){
+			perror(path);
+			close(fd);
+			return 126;
+		}
+	}
+	close(fd);
+	arena_create(&s.arena);
+	s.first = NULL;
+	s.last = NULL;
+	s.line_count = 0;
+	hash = hash_text(text, st.st_size);
+	cache = cache_path(hash);
+	if(cache == NULL || !load_cache(&s, cache, hash, st.st_size)){
+		parse_script(&s, text, st.st_size);
+		if(cache){
+			save_cache(&s, cache, hash, st.st_size);
+		}
+	}
+	free(cache);
+	for(line = s.first; line; line = line->next){
+		if(line->root){
+			exit_code = execute_line(line->root);
+			glob_cache_clear();
+		}else{
+			fprintf(stderr, "%s: %s\n", path, line->error);
+			exit_code = 2;
+		}
+		jobs_reap();
+	}
+	return exit_code;
+}
@@ -0,0 +1,10 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+//run a script file: it is parsed as a whole before the execution, the
+//parsed lines are saved into a cache file named by a hash of the
+//script text, so the next run of the same script skips parsing.
+//The result is the exit code of the last line
+int run_script(const char* path);
+
+#endif
@@ -0,0 +1,300 @@
+#define _GNU_SOURCE
+#include "stream.h"
+#include "pathhash.h"
+#include "vars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/sendfile.h>
+
+#define STREAM_CHUNK_SIZE (1 << 20)
+#define STREAM_BUFFER_SIZE 65536
+
+
+static bool is_pipe(int fd)
+{
+	struct stat st;
+	return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+static bool is_regular(int fd)
+{
+	struct stat st;
+	return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+int write_all(int fd, const char* data, ssize_t size)
+{
+	while(size > 0){
+		ssize_t n = write(fd, data, size);
+		if(n < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			return -1;
+		}
+		data += n;
+		size -= n;
+	}
+	return 0;
+}
+
+static int copy_rw(int in, int out)
+{
+	static char buf[STREAM_BUFFER_SIZE];
+	while(1){
+		ssize_t n = read(in, buf, sizeof(buf));
+		if(n == 0){
+			return 0;
+		}
+		if(n < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			return -1;
+		}
+		if(write_all(out, buf, n) != 0){
+			return -1;
+		}
+	}
+}
+
+//splice() and sendfile() fail with EINVAL before the first byte on
+//descriptors they do not support, e.g. a terminal or an O_APPEND file,
+//then the data is copied in user space
+int copy_fd(int in, int out)
+{
+	bool is_spliced = is_pipe(in) || is_pipe(out);
+	if(!is_spliced && !is_regular(in)){
+		return copy_rw(in, out);
+	}
+	while(1){
+		ssize_t n;
+		if(is_spliced){
+			n = splice(in, NULL, out, NULL, STREAM_CHUNK_SIZE,
+				SPLICE_F_MOVE);
+		}else{
+			n = sendfile(out, in, NULL, STREAM_CHUNK_SIZE);
+		}
+		if(n == 0){
+			return 0;
+		}
+		if(n < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			if(errno == EINVAL || errno == ENOSYS){
+				return copy_rw(in, out);
+			}
+			return -1;
+		}
+	}
+}
+
+//the builtins do not know every option of the programs with the
+//same name, such calls are given to the programs
+static int run_program(char** argv)
+{
+	const char* path = path_lookup(argv[0]);
+	pid_t pid;
+	int status;
+	int err;
+	if(path == NULL){
+		fprintf(stderr, "%s: command not found\n", argv[0]);
+		return 127;
+	}
+	fflush(stdout);
+	err = posix_spawn(&pid, path, NULL, NULL, argv, vars_environ());
+	if(err != 0){
+		fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+		return 127;
+	}
+	if(waitpid(pid, &status, 0) != pid){
+		return 1;
+	}
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+static bool has_options(int argc, char** argv, const char* known)
+{
+	int i;
+	for(i = 1; i < argc; i++){
+		if(argv[i][0] == '-' && argv[i][1] != 0 &&
+			(known == NULL || strcmp(argv[i], known) != 0)){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int builtin_cat(int argc, char** argv)
+{
+	int exit_code = 0;
+	int i;
+	if(has_options(argc, argv, NULL)){
+		return run_program(argv);
+	}
+	if(argc == 1){
+		return copy_fd(0, 1) == 0 ? 0 : 1;
+	}
+	for(i = 1; i < argc; i++){
+		int fd = 0;
+		if(strcmp(argv[i], "-") != 0){
+			fd = open(argv[i], O_RDONLY|O_CLOEXEC);
+		}
+		if(fd == -1){
+			fprintf(stderr, "cat: %s: %s\n", argv[i], strerror(errno));
+			exit_code = 1;
+			continue;
+		}
+		if(copy_fd(fd, 1) != 0){
+			fprintf(stderr, "cat: %s: %s\n", argv[i], strerror(errno));
+			exit_code = 1;
+		}
+		if(fd != 0){
+			close(fd);
+		}
+	}
+	return exit_code;
+}
+
+//move exactly size bytes from a pipe to fd, which is not read
+static int splice_all(int in, int out, ssize_t size)
+{
+	while(size > 0){
+		ssize_t n = splice(in, NULL, out, NULL, size, SPLICE_F_MOVE);
+		if(n < 0 && errno == EINTR){
+			continue;
+		}
+		if(n <= 0){
+			return -1;
+		}
+		size -= n;
+	}
+	return 0;
+}
+
+//tee() copies the pipe data without consuming it: into stdout, then
+//into a scratch pipe for each file but the last one, the last file
+//consumes the data with splice()
+static int tee_pipes(int* files, int count)
+{
+	int scratch[2] = {-1, -1};
+	int res = -1;
+	int devnull = -1;
+	if(count > 1){
+		if(pipe2(scratch, O_CLOEXEC) != 0){
+			return -1;
+		}
+		//so as tee() into it always takes everything at once
+		fcntl(scratch[1], F_SETPIPE_SZ, fcntl(0, F_GETPIPE_SZ));
+	}
+	if(count == 0){
+		devnull = open("/dev/null", O_WRONLY|O_CLOEXEC);
+		files = &devnull;
+		count = 1;
+	}
+	while(1){
+		ssize_t n = tee(0, 1, INT_MAX, 0);
+		int i;
+		if(n < 0 && errno == EINTR){
+			continue;
+		}
+		if(n <= 0){
+			res = n;
+			break;
+		}
+		for(i = 0; i + 1 < count; i++){
+			if(tee(0, scratch[1], n, 0) != n ||
+				splice_all(scratch[0], files[i], n) != 0){
+				goto close_pipes;
+			}
+		}
+		if(splice_all(0, files[count - 1], n) != 0){
+			goto close_pipes;
+		}
+	}
+close_pipes:
+	if(scratch[0] != -1){
+		close(scratch[0]);
+		close(scratch[1]);
+	}
+	if(devnull != -1){
+		close(devnull);
+	}
+	return res;
+}
+
+//user space copy for the descriptors, which are not pipes
+static int tee_rw(int* files, int count)
+{
+	static char buf[STREAM_BUFFER_SIZE];
+	int res = 0;
+	while(1){
+		ssize_t n = read(0, buf, sizeof(buf));
+		int i;
+		if(n < 0 && errno == EINTR){
+			continue;
+		}
+		if(n <= 0){
+			return n < 0 ? -1 : res;
+		}
+		if(write_all(1, buf, n) != 0){
+			return -1;
+		}
+		for(i = 0; i < count; i++){
+			if(files[i] != -1 && write_all(files[i], buf, n) != 0){
+				files[i] = -1;
+				res = -1;
+			}
+		}
+	}
+}
+
+int builtin_tee(int argc, char** argv)
+{
+	int flags = O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC;
+	int files[argc];
+	int count = 0;
+	int exit_code = 0;
+	int res;
+	int i = 1;
+	if(has_options(argc, argv, "-a")){
+		return run_program(argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "-a") == 0){
+		flags = O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC;
+		i++;
+	}
+	for(; i < argc; i++){
+		int fd = open(argv[i], flags, 0666);
+		if(fd == -1){
+			fprintf(stderr, "tee: %s: %s\n", argv[i], strerror(errno));
+			exit_code = 1;
+			continue;
+		}
+		files[count++] = fd;
+	}
+	//splice() does not write into O_APPEND files
+	if(is_pipe(0) && is_pipe(1) && !(flags & O_APPEND)){
+		res = tee_pipes(files, count);
+	}else{
+		res = tee_rw(files, count);
+	}
+	if(res != 0){
+		perror("tee");
+		exit_code = 1;
+	}
+	for(i = 0; i < count; i++){
+		close(files[i]);
+	}
+	return exit_code;
+}
@@ -0,0 +1,21 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <sys/types.h>
+
+//write everything, retry on partial writes and EINTR. -1 on error
+int write_all(int fd, const char* data, ssize_t size);
+
+//copy everything from in to out in the kernel, when it is possible:
+//splice() if one of the descriptors is a pipe, sendfile() from a
+//regular file, read() and write() otherwise. -1 on error
+int copy_fd(int in, int out);
+
+//cat [file...] without options, others are passed to the cat program
+int builtin_cat(int argc, char** argv);
+
+//tee [-a] [file...]. When stdin and stdout are pipes, the data is
+//duplicated with tee() and never crosses user space
+int builtin_tee(int argc, char** argv);
+
+#endif
@@ -0,0 +1,294 @@
+#include "vars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define VARS_START_SIZE 64
+
+extern char** environ;
+
+struct var{
+	//NAME=value, so the environment points to it as is
+	char* entry;
+	int name_len;
+	unsigned hash;
+	bool is_export;
+	struct var* next;
+};
+
+//chained hash table, as the one of pathhash.c
+static struct var** buckets = NULL;
+static int bucket_count = 0;
+static int var_count = 0;
+static int export_count = 0;
+//the environment is rebuilt on demand after changes of exported ones
+static char** env = NULL;
+static bool is_env_dirty = 1;
+static char status_str[16] = "0";
+static char pid_str[16] = "";
+
+static unsigned hash_name(const char* name, int len)
+{
+	unsigned h = 2166136261u;
+	int i;
+	for(i = 0; i < len; i++){
+		h = (h ^ (unsigned char)name[i]) * 16777619u;
+	}
+	return h;
+}
+
+bool is_var_name(const char* name, int len)
+{
+	int i;
+	if(len == 0 || (name[0] >= '0' && name[0] <= '9')){
+		return 0;
+	}
+	for(i = 0; i < len; i++){
+		char c = name[i];
+		if(!(c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+			(c >= '0' && c <= '9'))){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static struct var** find_var(const char* name, int len, unsigned h)
+{
+	struct var** p;
+	if(bucket_count == 0){
+		return NULL;
+	}
+	p = &buckets[h & (bucket_count - 1)];
+	while(*p && ((*p)->hash != h || (*p)->name_len != len ||
+		memcmp((*p)->entry, name, len) != 0)){
+		p = &(*p)->next;
+	}
+	return p;
+}
+
+static void grow_buckets()
+{
+	int new_count = bucket_count ? bucket_count * 2 : VARS_START_SIZE;
+	struct var** new_buckets = (struct var**)calloc(new_count,
+		sizeof(struct var*));
+	int i;
+	if(new_buckets == NULL){
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	for(i = 0; i < bucket_count; i++){
+		while(buckets[i]){
+			struct var* v = buckets[i];
+			buckets[i] = v->next;
+			v->next = new_buckets[v->hash & (new_count - 1)];
+			new_buckets[v->hash & (new_count - 1)] = v;
+		}
+	}
+	free(buckets);
+	buckets = new_buckets;
+	bucket_count = new_count;
+}
+
+static char* make_entry(const char* name, int name_len, const char* value)
+{
+	int value_len = strlen(value);
+	char* entry = (char*)malloc(name_len + value_len + 2);
+	memcpy(entry, name, name_len);
+	entry[name_len] = '=';
+	memcpy(entry + name_len + 1, value, value_len + 1);
+	return entry;
+}
+
+static void set_var(const char* name, int len, const char* value,
+	bool is_export)
+{
+	unsigned h = hash_name(name, len);
+	struct var** p = find_var(name, len, h);
+	struct var* v;
+	//value can point into the old entry, as for export NAME
+	char* entry = make_entry(name, len, value);
+	if(p && *p){
+		v = *p;
+		free(v->entry);
+		v->entry = entry;
+		if(is_export && !v->is_export){
+			v->is_export = 1;
+			export_count++;
+		}
+		is_env_dirty |= v->is_export;
+		return;
+	}
+	if(var_count >= bucket_count){
+		grow_buckets();
+	}
+	v = (struct var*)malloc(sizeof(struct var));
+	v->entry = entry;
+	v->name_len = len;
+	v->hash = h;
+	v->is_export = is_export;
+	v->next = buckets[h & (bucket_count - 1)];
+	buckets[h & (bucket_count - 1)] = v;
+	var_count++;
+	export_count += is_export;
+	is_env_dirty |= is_export;
+}
+
+void vars_init()
+{
+	char** e;
+	for(e = environ; *e; e++){
+		const char* eq = strchr(*e, '=');
+		if(eq && is_var_name(*e, eq - *e)){
+			set_var(*e, eq - *e, eq + 1, 1);
+		}
+	}
+	snprintf(pid_str, sizeof(pid_str), "%d", (int)getpid());
+}
+
+const char* var_get(const char* name)
+{
+	int len = strlen(name);
+	struct var** p;
+	if(len == 1 && name[0] == '?'){
+		return status_str;
+	}
+	if(len == 1 && name[0] == '$'){
+		return pid_str;
+	}
+	p = find_var(name, len, hash_name(name, len));
+	return p && *p ? (*p)->entry + len + 1 : NULL;
+}
+
+void var_set(const char* name, const char* value, bool is_export)
+{
+	set_var(name, strlen(name), value, is_export);
+}
+
+void var_assign(const char* assignment)
+{
+	const char* eq = strchr(assignment, '=');
+	set_var(assignment, eq - assignment, eq + 1, 0);
+}
+
+void var_unset(const char* name)
+{
+	int len = strlen(name);
+	struct var** p = find_var(name, len, hash_name(name, len));
+	struct var* v;
+	if(p == NULL || *p == NULL){
+		return;
+	}
+	v = *p;
+	*p = v->next;
+	if(v->is_export){
+		export_count--;
+		is_env_dirty = 1;
+	}
+	free(v->entry);
+	free(v);
+	var_count--;
+}
+
+void vars_set_status(int exit_code)
+{
+	snprintf(status_str, sizeof(status_str), "%d", exit_code);
+}
+
+char** vars_environ()
+{
+	int i;
+	int n = 0;
+	if(!is_env_dirty){
+		return env;
+	}
+	env = (char**)realloc(env, (export_count + 1) * sizeof(char*));
+	for(i = 0; i < bucket_count; i++){
+		struct var* v;
+		for(v = buckets[i]; v; v = v->next){
+			if(v->is_export){
+				env[n++] = v->entry;
+			}
+		}
+	}
+	env[n] = NULL;
+	is_env_dirty = 0;
+	return env;
+}
+
+//true if the entry is overridden by one of the assignments
+static bool is_assigned(const char* entry, char** assignments, int count)
+{
+	int len = strchr(entry, '=') - entry + 1;
+	int i;
+	for(i = 0; i < count; i++){
+		if(strncmp(entry, assignments[i], len) == 0){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+char** vars_environ_with(char** assignments, int count)
+{
+	char** base = vars_environ();
+	char** res = (char**)malloc((export_count + count + 1) *
+		sizeof(char*));
+	int n = 0;
+	int i;
+	for(i = 0; base[i]; i++){
+		if(!is_assigned(base[i], assignments, count)){
+			res[n++] = base[i];
+		}
+	}
+	for(i = 0; i < count; i++){
+		res[n++] = assignments[i];
+	}
+	res[n] = NULL;
+	return res;
+}
+
+int builtin_export(int argc, char** argv)
+{
+	int exit_code = 0;
+	int i;
+	if(argc == 1){
+		char** e;
+		for(e = vars_environ(); *e; e++){
+			const char* eq = strchr(*e, '=');
+			printf("export %.*s=\"%s\"\n", (int)(eq - *e), *e, eq + 1);
+		}
+		return 0;
+	}
+	for(i = 1; i < argc; i++){
+		const char* eq = strchr(argv[i], '=');
+		int len = eq ? eq - argv[i] : (int)strlen(argv[i]);
+		const char* value;
+		if(!is_var_name(argv[i], len)){
+			fprintf(stderr, "export: `%s': not a valid identifier\n",
+				argv[i]);
+			exit_code = 1;
+			continue;
+		}
+		if(eq){
+			value = eq + 1;
+		}else{
+			//a variable is exported with its current value
+			struct var** p = find_var(argv[i], len,
+				hash_name(argv[i], len));
+			value = p && *p ? (*p)->entry + len + 1 : "";
+		}
+		set_var(argv[i], len, value, 1);
+	}
+	return exit_code;
+}
+
+int builtin_unset(int argc, char** argv)
+{
+	int i;
+	for(i = 1; i < argc; i++){
+		var_unset(argv[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include <stdbool.h>
+
+//shell variables: name -> value, exported ones form the environment
+//of the commands. The environment of the shell is imported at start
+
+void vars_init();
+
+//value of a variable, NULL if it is not set. $? and $$ are special
+const char* var_get(const char* name);
+
+//set a variable, an exported one stays exported
+void var_set(const char* name, const char* value, bool is_export);
+
+//NAME=value as a word of a command
+void var_assign(const char* assignment);
+
+void var_unset(const char* name);
+
+//true for a valid variable name of len bytes
+bool is_var_name(const char* name, int len);
+
+//exit code of the last command for $?
+void vars_set_status(int exit_code);
+
+//NULL-terminated environment for exec: it is rebuilt only after an
+//exported variable has changed
+char** vars_environ();
+
+//environment with NAME=value assignments on top, for a command with
+//them. It is malloc'ed, the strings are not copied
+char** vars_environ_with(char** assignments, int count);
+
+//export [name[=value]...]: without arguments print exported variables
+int builtin_export(int argc, char** argv);
+
+int builtin_unset(int argc, char** argv);
+
+#endif
@@ -133,6 +133,71 @@ test_io(void)
 	unit_test_finish();
 }
 
+static void
+test_stress_delete(void)
+{
+	unit_test_start();
+
+	const int count = 30000;
+	char name[16], buf[16];
+	int *fd = (int *) malloc(count * sizeof(int));
+	unit_msg("create %d files, keep every third one opened", count);
+	for (int i = 0; i < count; ++i) {
+		int name_len = sprintf(name, "f%d", i) + 1;
+		fd[i] = ufs_open(name, UFS_CREATE);
+		unit_fail_if(fd[i] == -1);
+		unit_fail_if(ufs_write(fd[i], name, name_len) != name_len);
+		if (i % 3 != 0) {
+			unit_fail_if(ufs_close(fd[i]) != 0);
+			fd[i] = -1;
+		}
+	}
+	unit_msg("delete every other file, opened ones become ghosts");
+	for (int i = 0; i < count; i += 2) {
+		sprintf(name, "f%d", i);
+		unit_fail_if(ufs_delete(name) != 0);
+	}
+	unit_msg("the rest is found, the deleted ones are not");
+	for (int i = 0; i < count; ++i) {
+		int name_len = sprintf(name, "f%d", i) + 1;
+		int tmp = ufs_open(name, 0);
+		if (i % 2 == 0) {
+			unit_fail_if(tmp != -1);
+			unit_fail_if(ufs_errno() != UFS_ERR_NO_FILE);
+			continue;
+		}
+		unit_fail_if(tmp == -1);
+		unit_fail_if(ufs_read(tmp, buf, sizeof(buf)) != name_len);
+		unit_fail_if(memcmp(buf, name, name_len) != 0);
+		unit_fail_if(ufs_close(tmp) != 0);
+	}
+	unit_msg("ghosts keep the data, the names can be taken again");
+	for (int i = 0; i < count; i += 2) {
+		int name_len = sprintf(name, "f%d", i) + 1;
+		int tmp = ufs_open(name, UFS_CREATE);
+		unit_fail_if(tmp == -1);
+		unit_fail_if(ufs_read(tmp, buf, sizeof(buf)) != 0);
+		unit_fail_if(ufs_close(tmp) != 0);
+		if (fd[i] != -1) {
+			unit_fail_if(ufs_close(fd[i]) != 0);
+			tmp = ufs_open(name, 0);
+			unit_fail_if(ufs_write(tmp, name, name_len) != name_len);
+			unit_fail_if(ufs_close(tmp) != 0);
+			fd[i] = -1;
+		}
+	}
+	for (int i = 0; i < count; ++i) {
+		sprintf(name, "f%d", i);
+		if (fd[i] != -1)
+			unit_fail_if(ufs_close(fd[i]) != 0);
+		unit_fail_if(ufs_delete(name) != 0);
+	}
+	unit_check(ufs_open("f1", 0) == -1, "all the files are deleted");
+	free(fd);
+
+	unit_test_finish();
+}
+
 static void
 test_delete(void)
 {
@@ -180,6 +245,73 @@ test_delete(void)
 	unit_test_finish();
 }
 
+static void
+test_seek(void)
+{
+	unit_test_start();
+
+	int fd = ufs_open("file", UFS_CREATE);
+	unit_fail_if(fd == -1);
+	const int block_count = 64 * 1024;
+	const int block = 512;
+	char buf[block], buf2[block];
+	unit_msg("write %d blocks, each is filled with its number", block_count);
+	for (int i = 0; i < block_count; ++i) {
+		memset(buf, i % 251, block);
+		unit_fail_if(ufs_write(fd, buf, block) != block);
+	}
+	off_t size = (off_t) block_count * block;
+	unit_check(ufs_seek(fd, 0, UFS_SEEK_CUR) == size,
+		   "the position is at the end");
+	unit_check(ufs_seek(fd, 0, UFS_SEEK_END) == size, "seek to the end");
+	unit_check(ufs_seek(fd, -size - 1, UFS_SEEK_END) == -1,
+		   "can not seek before the beginning");
+	unit_check(ufs_errno() == UFS_ERR_INVALID_ARG, "errno is set");
+	unit_check(ufs_seek(fd, 100, UFS_SEEK_SET) == 100, "seek to 100");
+	unit_check(ufs_read(fd, buf2, 10) == 10, "read from there");
+	unit_check(buf2[0] == 0 && buf2[9] == 0, "it is the first block");
+	unit_check(ufs_seek(fd, block - 110, UFS_SEEK_CUR) == block,
+		   "seek forward from the position");
+	unit_check(ufs_read(fd, buf2, 1) == 1 && buf2[0] == 1,
+		   "it is the second block");
+
+	unit_msg("random reads and writes do not move the position");
+	unsigned seed = 1;
+	for (int i = 0; i < 100000; ++i) {
+		seed = seed * 1103515245 + 12345;
+		off_t offset = seed % (size - 2);
+		int n = (offset + 1) / block;
+		unit_fail_if(ufs_pread(fd, buf2, 2, offset) != 2);
+		unit_fail_if(buf2[1] != (char) (n % 251));
+	}
+	unit_fail_if(ufs_pwrite(fd, "xyz", 3, block * 10 - 1) != 3);
+	unit_fail_if(ufs_pread(fd, buf2, 5, block * 10 - 2) != 5);
+	unit_check(memcmp(buf2, "\x09xyz\x0a", 5) == 0,
+		   "pwrite over a block border");
+	unit_check(ufs_seek(fd, 0, UFS_SEEK_CUR) == block + 1,
+		   "the position is the same");
+
+	unit_msg("a write after the end");
+	unit_check(ufs_pread(fd, buf2, 1, size + 10) == 0, "read gives EOF");
+	unit_check(ufs_seek(fd, size + block, UFS_SEEK_SET) == size + block,
+		   "seek after the end");
+	unit_check(ufs_write(fd, "end", 3) == 3, "write there");
+	unit_check(ufs_pread(fd, buf2, block, size) == block, "read the gap");
+	memset(buf, 0, block);
+	unit_check(memcmp(buf, buf2, block) == 0, "it is zeros");
+	unit_check(ufs_seek(fd, 0, UFS_SEEK_END) == size + block + 3,
+		   "the size is changed");
+	unit_check(ufs_pwrite(fd, "a", 1, -1) == -1, "negative offset");
+	unit_check(ufs_errno() == UFS_ERR_INVALID_ARG, "errno is set");
+
+	unit_fail_if(ufs_close(fd) != 0);
+	unit_check(ufs_seek(fd, 0, UFS_SEEK_SET) == -1, "seek of a closed fd");
+	unit_check(ufs_errno() == UFS_ERR_NO_FILE, "errno is set");
+	unit_fail_if(ufs_delete("file") != 0);
+
+	unit_test_finish();
+}
+
 static void
 test_max_file_size(void)
 {
@@ -285,6 +417,8 @@ main(void)
 	test_io();
 	test_delete();
 	test_stress_open();
+	test_stress_delete();
+	test_seek();
 	test_max_file_size();
 	test_rights();
 
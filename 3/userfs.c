@@ -17,35 +17,22 @@ static enum ufs_error_code ufs_errcode = UFS_ERR_NO_ERR;
 
 struct block {
 	/** Block memory. */
-	char *memory;
-	/** How many bytes are occupied. */
-	int occupied;
-	/** Next block in the file. */
-	struct block *next;
-	/** Previous block in the file. */
-	struct block *prev;
+	char memory[BLOCK_SIZE];
 
 	/* PUT HERE OTHER MEMBERS */
 };
 
-static struct block* new_block()
-{
-	struct block* block = malloc(sizeof(struct block));
-	block->memory = malloc(BLOCK_SIZE * sizeof(char));
-	block->occupied = 0;
-	block->next = NULL;
-	block->prev = NULL;
-	return block;
-}
-
 struct file {
-	/** Double-linked list of file blocks. */
-	struct block *block_list;
 	/**
-	 * Last block in the list above for fast access to the end
-	 * of file.
+	 * Index of the file blocks: block i keeps the bytes from
+	 * i * BLOCK_SIZE, so any offset is found without a walk.
+	 * The bytes after the file size are zeros.
 	 */
-	struct block *last_block;
+	struct block **blocks;
+	/** Capacity of the index. */
+	int max_blocks;
+	/** File size in bytes. */
+	size_t size;
 	/** How many file descriptors are opened on the file. */
 	int refs;
 	/** File name. */
@@ -56,9 +43,20 @@ struct file {
 
 	bool deleted;
 	int num_blocks;
+	/** Hash of the name, so the index is grown without strlen. */
+	unsigned hash;
 	/* PUT HERE OTHER MEMBERS */
 };
 
+static unsigned hash_name(const char* name)
+{
+	unsigned h = 2166136261u;
+	for(; *name; name++){
+		h = (h ^ (unsigned char)*name) * 16777619u;
+	}
+	return h;
+}
+
 static struct file* new_file(const char* filename)
 {
 	struct file* file = malloc(sizeof(struct file));
@@ -67,18 +65,103 @@ static struct file* new_file(const char* filename)
 	memcpy(file->name, filename, strlen(filename)+1);
 	file->next = NULL;
 	file->prev = NULL;
-	file->block_list = NULL;
-	file->last_block = NULL;
+	file->blocks = NULL;
+	file->max_blocks = 0;
+	file->size = 0;
 	file->deleted = 0;
 	file->num_blocks = 0;
+	file->hash = hash_name(filename);
 	return file;
 }
 
 /** List of all files. */
 static struct file *file_list = NULL;
 
+/**
+ * Name index of the files from the list above: open addressing
+ * with linear probing, the size is a power of 2 and at most a
+ * half of the slots is taken. Deleted files are not in the index,
+ * even when they are still opened.
+ */
+static struct file **file_index = NULL;
+static int file_index_size = 0;
+static int file_index_count = 0;
+
+//the slot of the file with the name or the empty slot, where it
+//would be
+static int find_slot(const char* filename, unsigned hash)
+{
+	int mask = file_index_size - 1;
+	int i = hash & mask;
+	while(file_index[i]){
+		if(file_index[i]->hash == hash &&
+			!strcmp(file_index[i]->name, filename)){
+			break;
+		}
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+static struct file* find_file(const char* filename)
+{
+	if(file_index_count == 0){
+		return NULL;
+	}
+	return file_index[find_slot(filename, hash_name(filename))];
+}
+
+static void grow_index()
+{
+	struct file** old = file_index;
+	int old_size = file_index_size;
+	file_index_size = old_size ? old_size * 2 : 64;
+	file_index = calloc(file_index_size, sizeof(struct file*));
+	for(int i = 0; i < old_size; i++){
+		if(old[i]){
+			file_index[find_slot(old[i]->name, old[i]->hash)] = old[i];
+		}
+	}
+	free(old);
+}
+
+static void index_file(struct file* file)
+{
+	if((file_index_count + 1) * 2 > file_index_size){
+		grow_index();
+	}
+	file_index[find_slot(file->name, file->hash)] = file;
+	file_index_count++;
+}
+
+//the next files of the probe sequence are moved back into the hole,
+//so a search never stops early and no tombstones are needed
+static void unindex_file(struct file* file)
+{
+	int mask = file_index_size - 1;
+	int i = find_slot(file->name, file->hash);
+	int j = i;
+	file_index[i] = NULL;
+	file_index_count--;
+	while(1){
+		j = (j + 1) & mask;
+		if(file_index[j] == NULL){
+			break;
+		}
+		int home = file_index[j]->hash & mask;
+		//the file can move, if its home slot is not in (i, j]
+		if((j > i && (home <= i || home > j)) ||
+			(j < i && home <= i && home > j)){
+			file_index[i] = file_index[j];
+			file_index[j] = NULL;
+			i = j;
+		}
+	}
+}
+
 static void unlink_file(struct file* file)
 {
+	unindex_file(file);
 	if(file->prev){
 		file->prev->next = file->next;
 	}
@@ -92,18 +175,17 @@ static void unlink_file(struct file* file)
 
 static void delete_file(struct file* file)
 {
-	while(file->block_list){
-		struct block* tmp = file->block_list;
-		file->block_list = file->block_list->next;
-		free(tmp->memory);
-		free(tmp);
+	for(int i = 0; i < file->num_blocks; i++){
+		free(file->blocks[i]);
 	}
+	free(file->blocks);
 	free(file->name);
 	free(file);
 }
 
 static void insert_file(struct file* file)
 {
+	index_file(file);
 	if(file_list == NULL){
 		file_list = file;
 		return;
@@ -113,27 +195,107 @@ static void insert_file(struct file* file)
 	file_list = file;
 }
 
-static struct block* increase_file(struct file* file)
+//allocate zeroed blocks up to the size, the index grows twice
+//at once. -1, if there is no memory
+static int reserve_blocks(struct file* file, size_t size)
+{
+	int num_blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	if(num_blocks > file->max_blocks){
+		int max_blocks = file->max_blocks ? file->max_blocks : 8;
+		while(max_blocks < num_blocks){
+			max_blocks *= 2;
+		}
+		void* new_mem = realloc(file->blocks,
+			max_blocks * sizeof(struct block*));
+		if(new_mem == NULL){
+			return -1;
+		}
+		file->blocks = new_mem;
+		file->max_blocks = max_blocks;
+	}
+	while(file->num_blocks < num_blocks){
+		struct block* block = calloc(1, sizeof(struct block));
+		if(block == NULL){
+			return -1;
+		}
+		file->blocks[file->num_blocks++] = block;
+	}
+	return 0;
+}
+
+//free the blocks after the size, the tail of the last one is
+//zeroed, so the file can grow back with zeros
+static void truncate_blocks(struct file* file, size_t size)
+{
+	int num_blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	while(file->num_blocks > num_blocks){
+		free(file->blocks[--file->num_blocks]);
+	}
+	if(size % BLOCK_SIZE != 0){
+		memset(file->blocks[num_blocks - 1]->memory + size % BLOCK_SIZE,
+			0, BLOCK_SIZE - size % BLOCK_SIZE);
+	}
+	file->size = size;
+}
+
+//copy from the offset, the block of each part is taken from the
+//index
+static size_t read_blocks(struct file* file, char* buf, size_t size,
+	size_t offset)
 {
-	struct block* block = new_block();
-	if(file->block_list == NULL){
-		file->block_list = block;
-		file->last_block = block;
-	}else{
-		file->last_block->next = block;
-		block->prev = file->last_block;
-		file->last_block = block;
-	}
-	file->num_blocks++;
-	return block;
+	if(offset >= file->size){
+		return 0;
+	}
+	if(size > file->size - offset){
+		size = file->size - offset;
+	}
+	size_t done = 0;
+	while(done < size){
+		size_t pos = offset + done;
+		size_t part = BLOCK_SIZE - pos % BLOCK_SIZE;
+		if(part > size - done){
+			part = size - done;
+		}
+		memcpy(buf + done,
+			file->blocks[pos / BLOCK_SIZE]->memory + pos % BLOCK_SIZE, part);
+		done += part;
+	}
+	return done;
+}
+
+//a write after the end fills the gap with zeros. -1, if there is no
+//memory or the file would be too big
+static ssize_t write_blocks(struct file* file, const char* buf,
+	size_t size, size_t offset)
+{
+	if(offset > MAX_FILE_SIZE || size > MAX_FILE_SIZE - offset){
+		return -1;
+	}
+	if(reserve_blocks(file, offset + size) != 0){
+		return -1;
+	}
+	size_t done = 0;
+	while(done < size){
+		size_t pos = offset + done;
+		size_t part = BLOCK_SIZE - pos % BLOCK_SIZE;
+		if(part > size - done){
+			part = size - done;
+		}
+		memcpy(file->blocks[pos / BLOCK_SIZE]->memory + pos % BLOCK_SIZE,
+			buf + done, part);
+		done += part;
+	}
+	if(offset + size > file->size){
+		file->size = offset + size;
+	}
+	return done;
 }
 
 struct filedesc {
 	struct file *file;
-	int block_num;
-	int block_pos;
+	/** Offset of the next read or write, can be after the end. */
+	size_t pos;
 	int rw_flags;
-	struct block* curr_block;
 
 	/* PUT HERE OTHER MEMBERS */
 };
@@ -142,10 +304,8 @@ static struct filedesc* new_fd(struct file* file, int flags)
 {
 	struct filedesc* fd = malloc(sizeof(struct filedesc));
 	fd->file = file;
-	fd->block_num = 0;
-	fd->block_pos = 0;
+	fd->pos = 0;
 	fd->rw_flags = flags;
-	fd->curr_block = NULL;
 	fd->file->refs++;
 	return fd;
 }
@@ -227,14 +387,10 @@ ufs_open(const char *filename, int flags)
 	if(fd_flags == 0){
 		fd_flags = UFS_READ_WRITE;
 	}
-	//Search File
-	struct file* file = file_list;
-	while(file){
-		if(!strcmp(file->name, filename)){
-			ufs_errcode = UFS_ERR_NO_ERR;
-			return insert_fd(new_fd(file, fd_flags)) + 1;
-		}
-		file = file->next;
+	struct file* file = find_file(filename);
+	if(file){
+		ufs_errcode = UFS_ERR_NO_ERR;
+		return insert_fd(new_fd(file, fd_flags)) + 1;
 	}
 	//No File
 	if(is_create){
@@ -248,110 +404,116 @@ ufs_open(const char *filename, int flags)
 	return -1;
 }
 
+//the descriptor with the access, which is asked for, NULL on error
+static struct filedesc* get_fd_for(int fd, int rw_flags)
+{
+	struct filedesc* filedesc = ufs_get_fd(fd);
+	if(filedesc == NULL){
+		ufs_errcode = UFS_ERR_NO_FILE;
+		return NULL;
+	}
+	if((filedesc->rw_flags & (rw_flags | UFS_READ_WRITE)) == 0){
+		ufs_errcode = UFS_ERR_NO_PERMISSION;
+		return NULL;
+	}
+	return filedesc;
+}
+
 ssize_t
 ufs_write(int fd, const char *buf, size_t size)
+{
+	struct filedesc* filedesc = get_fd_for(fd, UFS_WRITE_ONLY);
+	if(filedesc == NULL){
+		return -1;
+	}
+	ssize_t rc = write_blocks(filedesc->file, buf, size, filedesc->pos);
+	if(rc == -1){
+		ufs_errcode = UFS_ERR_NO_MEM;
+		return -1;
+	}
+	filedesc->pos += rc;
+	ufs_errcode = UFS_ERR_NO_ERR;
+	return rc;
+}
+
+ssize_t
+ufs_read(int fd, char *buf, size_t size)
+{
+	struct filedesc* filedesc = get_fd_for(fd, UFS_READ_ONLY);
+	if(filedesc == NULL){
+		return -1;
+	}
+	size_t rc = read_blocks(filedesc->file, buf, size, filedesc->pos);
+	filedesc->pos += rc;
+	ufs_errcode = UFS_ERR_NO_ERR;
+	return rc;
+}
+
+off_t
+ufs_seek(int fd, off_t offset, int whence)
 {
 	struct filedesc* filedesc = ufs_get_fd(fd);
 	if(filedesc == NULL){
 		ufs_errcode = UFS_ERR_NO_FILE;
 		return -1;
 	}
-	if((filedesc->rw_flags & (UFS_WRITE_ONLY | UFS_READ_WRITE)) == 0)
-	{
-		ufs_errcode = UFS_ERR_NO_PERMISSION; 
+	off_t base;
+	switch(whence){
+	case UFS_SEEK_SET:
+		base = 0;
+		break;
+	case UFS_SEEK_CUR:
+		base = filedesc->pos;
+		break;
+	case UFS_SEEK_END:
+		base = filedesc->file->size;
+		break;
+	default:
+		ufs_errcode = UFS_ERR_INVALID_ARG;
 		return -1;
 	}
-	int curr_size;
-	if(filedesc->block_num == 0){
-		curr_size = 0;
-	}else{
-		curr_size = (filedesc->block_num-1)*BLOCK_SIZE
-			+ filedesc->block_pos;
+	if(offset < -base || offset > MAX_FILE_SIZE - base){
+		ufs_errcode = UFS_ERR_INVALID_ARG;
+		return -1;
 	}
-	if(curr_size + size > MAX_FILE_SIZE)
-	{
-		ufs_errcode = UFS_ERR_NO_MEM;
+	filedesc->pos = base + offset;
+	ufs_errcode = UFS_ERR_NO_ERR;
+	return filedesc->pos;
+}
+
+ssize_t
+ufs_pread(int fd, char *buf, size_t size, off_t offset)
+{
+	struct filedesc* filedesc = get_fd_for(fd, UFS_READ_ONLY);
+	if(filedesc == NULL){
 		return -1;
 	}
-	if(filedesc->curr_block == NULL){
-		if(filedesc->file->block_list){
-			filedesc->curr_block = filedesc->file->block_list;
-		}else{
-			filedesc->curr_block = increase_file(filedesc->file);
-		}
-		filedesc->block_num = 1;
-	}
-	int b_written = 0;
-	while(size){
-		if(filedesc->block_pos == BLOCK_SIZE){
-			filedesc->block_pos = 0;
-			filedesc->block_num++;
-			if(filedesc->curr_block->next == NULL){
-				increase_file(filedesc->file);
-			}
-			filedesc->curr_block = filedesc->curr_block->next;
-		}
-		int free_b = BLOCK_SIZE - filedesc->curr_block->occupied;
-		int b_to_write = size > free_b ? free_b : size;
-		memcpy(&(filedesc->curr_block->memory[filedesc->block_pos]),
-			&(buf[b_written]), b_to_write);
-		filedesc->block_pos += b_to_write;
-		b_written += b_to_write;
-		size -= b_to_write;
-		if(filedesc->block_pos > filedesc->curr_block->occupied){
-			filedesc->curr_block->occupied = filedesc->block_pos;
-		}
+	if(offset < 0){
+		ufs_errcode = UFS_ERR_INVALID_ARG;
+		return -1;
 	}
 	ufs_errcode = UFS_ERR_NO_ERR;
-	return b_written;
+	return read_blocks(filedesc->file, buf, size, offset);
 }
 
 ssize_t
-ufs_read(int fd, char *buf, size_t size)
+ufs_pwrite(int fd, const char *buf, size_t size, off_t offset)
 {
-	struct filedesc* filedesc = ufs_get_fd(fd);
+	struct filedesc* filedesc = get_fd_for(fd, UFS_WRITE_ONLY);
 	if(filedesc == NULL){
-		ufs_errcode = UFS_ERR_NO_FILE;
 		return -1;
 	}
-	if((filedesc->rw_flags & (UFS_READ_ONLY | UFS_READ_WRITE)) == 0)
-	{
-		ufs_errcode = UFS_ERR_NO_PERMISSION; 
+	if(offset < 0){
+		ufs_errcode = UFS_ERR_INVALID_ARG;
 		return -1;
 	}
-	if(filedesc->curr_block == NULL)
-	{
-		if(filedesc->file->block_list == NULL){
-			ufs_errcode = UFS_ERR_NO_ERR;
-			return 0;
-		}
-		filedesc->curr_block = filedesc->file->block_list;
-		filedesc->block_num = 1;
-	}
-	int b_read = 0;
-	while(size){
-		if(filedesc->block_pos == BLOCK_SIZE){
-			if(filedesc->curr_block->next == NULL){
-				ufs_errcode = UFS_ERR_NO_ERR;
-				return b_read;
-			}
-			filedesc->block_pos = 0;
-			filedesc->block_num++;
-			filedesc->curr_block = filedesc->curr_block->next;
-		}
-		if(filedesc->block_pos == filedesc->curr_block->occupied){
-			return b_read;
-		}
-		int free_b = filedesc->curr_block->occupied - filedesc->block_pos;
-		int b_to_read = size > free_b ? free_b : size;
-		memcpy(&(buf[b_read]),
-			&(filedesc->curr_block->memory[filedesc->block_pos]), b_to_read);
-		filedesc->block_pos += b_to_read;
-		b_read += b_to_read;
-		size -= b_to_read;
+	ssize_t rc = write_blocks(filedesc->file, buf, size, offset);
+	if(rc == -1){
+		ufs_errcode = UFS_ERR_NO_MEM;
+		return -1;
 	}
 	ufs_errcode = UFS_ERR_NO_ERR;
-	return b_read;
+	return rc;
 }
 
 int
@@ -370,22 +532,18 @@ ufs_close(int fd)
 int
 ufs_delete(const char *filename)
 {
-	//Search File
-	struct file* file = file_list;
-	while(file){
-		if(!strcmp(file->name, filename)){
-			unlink_file(file);
-			file->deleted = 1;
-			if(file->refs == 0){
-				delete_file(file);
-			}
-			ufs_errcode = UFS_ERR_NO_ERR;
-			return 0;
-		}
-		file = file->next;
+	struct file* file = find_file(filename);
+	if(file == NULL){
+		ufs_errcode = UFS_ERR_NO_FILE;
+		return -1;
 	}
-	ufs_errcode = UFS_ERR_NO_FILE;
-	return -1;
+	unlink_file(file);
+	file->deleted = 1;
+	if(file->refs == 0){
+		delete_file(file);
+	}
+	ufs_errcode = UFS_ERR_NO_ERR;
+	return 0;
 }
 
 int
@@ -401,65 +559,23 @@ ufs_resize(int fd, size_t new_size)
 		return -1;
 	}
 	struct file* file = filedesc->file;
-	size_t old_size;
-	if(file->num_blocks == 0){
-		old_size = 0;
-	}else{
-		old_size = (file->num_blocks-1) * BLOCK_SIZE
-			+ file->last_block->occupied;
-	}
-	int new_num_blocks = new_size/BLOCK_SIZE + 1;
-	int new_block_pos = new_size%BLOCK_SIZE;
-	if(new_block_pos == 0){
-		new_block_pos = 512;
-		new_num_blocks--;
-	}
-	//Increase file size
-	if(new_size >= old_size){
-		while(file->num_blocks < new_num_blocks){
-			increase_file(file);
+	//Increase file size, the new bytes are zeros
+	if(new_size >= file->size){
+		if(reserve_blocks(file, new_size) != 0){
+			ufs_errcode = UFS_ERR_NO_MEM;
+			return -1;
 		}
+		file->size = new_size;
 		ufs_errcode = UFS_ERR_NO_ERR;
 		return 0;
 	}
-	//Find new last block
-	struct block* new_last_block = NULL;
-	if(new_num_blocks > 0){
-		new_last_block = file->block_list;
-	}
-	for(int i = 1; i < new_num_blocks; ++i){
-		new_last_block = new_last_block->next;
-	}
-	//delete rest file
-	struct block* tmp = new_last_block->next;
-	while(tmp){
-		struct block* tmp2 = tmp;
-		tmp = tmp->next;
-		free(tmp2->memory);
-		free(tmp2);
-	}
-	//set new last block
-	file->last_block = new_last_block;
-	file->num_blocks = new_num_blocks;
-	if(new_last_block == NULL){
-		file->block_list = NULL;
-	}else{
-		file->last_block->occupied = new_block_pos;
-		new_last_block->next = NULL;
-	}
+	truncate_blocks(file, new_size);
 	//find fds with the same file and move position if needed
 	for(int i = 0; i < file_descriptor_capacity; ++i){
 		struct filedesc* filedesc = file_descriptors[i];
-		if(filedesc && (filedesc->file == file)){
-			if(filedesc->block_num >= file->num_blocks){
-				filedesc->block_num = file->num_blocks;
-				filedesc->curr_block = file->last_block;
-				if(filedesc->curr_block == NULL){
-					filedesc->block_pos = 0;
-				}else{
-					filedesc->block_pos = file->last_block->occupied;
-				}
-			}
+		if(filedesc && filedesc->file == file &&
+			filedesc->pos > new_size){
+			filedesc->pos = new_size;
 		}
 	}
 	ufs_errcode = UFS_ERR_NO_ERR;
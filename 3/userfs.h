@@ -58,6 +58,7 @@ enum ufs_error_code {
 	UFS_ERR_NO_FILE,
 	UFS_ERR_NO_MEM,
 	UFS_ERR_NOT_IMPLEMENTED,
+	UFS_ERR_INVALID_ARG,
 
 #ifdef NEED_OPEN_FLAGS
 
@@ -65,6 +66,16 @@ enum ufs_error_code {
 #endif
 };
 
+/** Where ufs_seek() counts the offset from. */
+enum ufs_seek_whence {
+	/** From the beginning of the file. */
+	UFS_SEEK_SET = 0,
+	/** From the current position of the descriptor. */
+	UFS_SEEK_CUR = 1,
+	/** From the end of the file. */
+	UFS_SEEK_END = 2,
+};
+
 /** Get code of the last error. */
 enum ufs_error_code
 ufs_errno();
@@ -110,6 +121,59 @@ ufs_write(int fd, const char *buf, size_t size);
 ssize_t
 ufs_read(int fd, char *buf, size_t size);
 
+/**
+ * Move the position of a descriptor. It is allowed to go after
+ * the end of the file, then a write fills the gap with zeros and
+ * a read returns EOF. Any position is found in constant time,
+ * the file keeps an index of its blocks.
+ * @param fd File descriptor from ufs_open().
+ * @param offset Offset from the point, set by @a whence.
+ * @param whence One of ufs_seek_whence.
+ *
+ * @retval >= 0 The new position.
+ * @retval -1 Error occurred. Check ufs_errno() for a code.
+ *     - UFS_ERR_NO_FILE - invalid file descriptor.
+ *     - UFS_ERR_INVALID_ARG - invalid @a whence, or the position
+ *       would be negative or bigger than the max file size.
+ */
+off_t
+ufs_seek(int fd, off_t offset, int whence);
+
+/**
+ * Read data from the given offset of the file. The position of
+ * the descriptor is not changed.
+ * @param fd File descriptor from ufs_open().
+ * @param buf Buffer to read into.
+ * @param size Maximum bytes to read.
+ * @param offset Offset in the file to read from.
+ *
+ * @retval > 0 How many bytes were read.
+ * @retval 0 EOF.
+ * @retval -1 Error occurred. Check ufs_errno() for a code.
+ *     - UFS_ERR_NO_FILE - invalid file descriptor.
+ *     - UFS_ERR_INVALID_ARG - negative @a offset.
+ */
+ssize_t
+ufs_pread(int fd, char *buf, size_t size, off_t offset);
+
+/**
+ * Write data to the given offset of the file. The position of the
+ * descriptor is not changed.
+ * @param fd File descriptor from ufs_open().
+ * @param buf Buffer to write.
+ * @param size Size of @a buf.
+ * @param offset Offset in the file to write to.
+ *
+ * @retval > 0 How many bytes were written.
+ * @retval -1 Error occurred. Check ufs_errno() for a code.
+ *     - UFS_ERR_NO_FILE - invalid file descriptor.
+ *     - UFS_ERR_NO_MEM - not enough memory, or the file would be
+ *       bigger than the max file size.
+ *     - UFS_ERR_INVALID_ARG - negative @a offset.
+ */
+ssize_t
+ufs_pwrite(int fd, const char *buf, size_t size, off_t offset);
+
 /**
  * Close a file.
  * @param fd File descriptor from ufs_open().
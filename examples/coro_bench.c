@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <setjmp.h>
+#include <alloca.h>
+#include <time.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include "12_libcoro.h"
+#include "coro_bench.h"
+
+/**
+ * Comparison of all the coroutine implementations of the repo:
+ * switch latency, spawn and teardown cost, memory per coroutine
+ * for different coroutine counts. Each coroutine just yields
+ * several times in a round-robin manner.
+ *
+ * You can compile and run the benchmark using the commands:
+ *
+ * $> gcc -O2 -pthread -I../1 -I../lecture_examples/4_signals \
+ *        coro_bench.c coro_bench_jmp.c \
+ *        ../lecture_examples/4_signals/12_libcoro.c
+ * $> ./a.out
+ *
+ * Add -U_FORTIFY_SOURCE, if the compiler defines it by default -
+ * fortified longjmp() does not allow to jump into another stack.
+ */
+
+enum {
+	/** Switches per one run, to get a stable average. */
+	BENCH_SWITCHES = 1000 * 1000,
+	/** Stack size as in 1/main.c and libcoro. */
+	BENCH_BIG_STACK = 1024 * 1024,
+	/** Stack size as in examples/coro_alloca.c. */
+	BENCH_SMALL_STACK = 8 * 1024,
+	/** Maximal size of a growable libcoro stack. */
+	BENCH_GROWABLE_STACK = 256 * 1024,
+};
+
+uint64_t
+bench_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+size_t
+bench_rss(void)
+{
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f == NULL)
+		return 0;
+	size_t size, rss = 0;
+	if (fscanf(f, "%zu %zu", &size, &rss) != 2)
+		rss = 0;
+	fclose(f);
+	return rss * getpagesize();
+}
+
+/** Average time per operation since @a start. */
+static inline double
+bench_avg(uint64_t start, uint64_t count)
+{
+	return (double) (bench_clock() - start) / count;
+}
+
+/** How many memory mappings the process can have. */
+static long
+bench_max_map_count(void)
+{
+	long res = 65530;
+	FILE *f = fopen("/proc/sys/vm/max_map_count", "r");
+	if (f == NULL)
+		return res;
+	if (fscanf(f, "%ld", &res) != 1)
+		res = 65530;
+	fclose(f);
+	return res;
+}
+
+#ifndef MADV_GUARD_INSTALL
+#define MADV_GUARD_INSTALL 102
+#endif
+
+/**
+ * How many memory mappings a growable libcoro stack takes. With
+ * guard regions of madvise() neighbour stacks merge into one
+ * mapping, so almost none. Otherwise the PROT_NONE guard page
+ * splits each stack into 2.
+ */
+static long
+bench_growable_map_count(void)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	void *p = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return 2;
+	int rc = madvise(p, page, MADV_GUARD_INSTALL);
+	munmap(p, 2 * page);
+	return rc == 0 ? 0 : 2;
+}
+
+/* {{{ swapcontext, as in 1/main.c and 1/example_swap.c */
+
+static ucontext_t uctx_main;
+static ucontext_t *uctx_coros;
+static int uctx_count;
+static int uctx_rounds;
+
+/**
+ * Yield to the next coroutine several times. On return the
+ * context goes to uc_link - the next coroutine, and the last one
+ * returns into the main context.
+ */
+static void
+uctx_body(int i)
+{
+	for (int r = 0; r < uctx_rounds; ++r)
+		swapcontext(&uctx_coros[i], &uctx_coros[(i + 1) % uctx_count]);
+}
+
+static void
+bench_uctx(int count, int rounds, struct bench_result *res)
+{
+	uctx_count = count;
+	uctx_rounds = rounds;
+	uctx_coros = (ucontext_t *) malloc(count * sizeof(ucontext_t));
+	void **stacks = (void **) calloc(count, sizeof(void *));
+	if (uctx_coros == NULL || stacks == NULL) {
+		res->skip_reason = "no memory";
+		goto free_mem;
+	}
+	size_t rss = bench_rss();
+	uint64_t start = bench_clock();
+	for (int i = 0; i < count; ++i) {
+		stacks[i] = malloc(BENCH_BIG_STACK);
+		if (stacks[i] == NULL) {
+			res->skip_reason = "no memory";
+			goto free_mem;
+		}
+		getcontext(&uctx_coros[i]);
+		uctx_coros[i].uc_stack.ss_sp = stacks[i];
+		uctx_coros[i].uc_stack.ss_size = BENCH_BIG_STACK;
+		uctx_coros[i].uc_link = i + 1 < count ? &uctx_coros[i + 1] :
+						       &uctx_main;
+		makecontext(&uctx_coros[i], (void (*)(void)) uctx_body, 1, i);
+	}
+	res->spawn = bench_avg(start, count);
+	start = bench_clock();
+	swapcontext(&uctx_main, &uctx_coros[0]);
+	res->yield = bench_avg(start, (uint64_t) count * rounds);
+	res->memory = ((double) bench_rss() - rss) / count;
+	start = bench_clock();
+	for (int i = 0; i < count; ++i) {
+		free(stacks[i]);
+		stacks[i] = NULL;
+	}
+	res->teardown = bench_avg(start, count);
+free_mem:
+	for (int i = 0; i < count && stacks != NULL; ++i)
+		free(stacks[i]);
+	free(stacks);
+	free(uctx_coros);
+}
+
+/* }}} */
+
+/* {{{ setjmp + alloca, as in examples/coro_alloca.c */
+
+struct alloca_coro {
+	jmp_buf ctx;
+};
+
+static struct alloca_coro *alloca_coros;
+static int alloca_count;
+static int alloca_rounds;
+/** Coroutine to start or continue. */
+static int alloca_i;
+/** The last finished coroutine jumps here. */
+static jmp_buf alloca_done;
+static struct bench_result *alloca_res;
+
+static void
+alloca_body(int i)
+{
+	/*
+	 * The counter is changed between setjmp() and longjmp()
+	 * back into this frame, so it is kept in memory.
+	 */
+	for (volatile int r = 0; r < alloca_rounds; ++r) {
+		if (setjmp(alloca_coros[i].ctx) == 0) {
+			alloca_i = (i + 1) % alloca_count;
+			longjmp(alloca_coros[alloca_i].ctx, 1);
+		}
+	}
+	/*
+	 * The next coroutine is on its last yield too, so it
+	 * finishes right after this one.
+	 */
+	if (i + 1 < alloca_count) {
+		alloca_i = i + 1;
+		longjmp(alloca_coros[alloca_i].ctx, 1);
+	}
+	longjmp(alloca_done, 1);
+}
+
+/**
+ * Stacks of all the coroutines are cut from the stack of this
+ * function, so it is run in a thread with a big enough stack.
+ */
+static void *
+alloca_run(void *arg)
+{
+	(void) arg;
+	static uint64_t start;
+	static size_t rss;
+	rss = bench_rss();
+	start = bench_clock();
+	for (int i = 0; i < alloca_count; ++i) {
+		if (setjmp(alloca_coros[i].ctx) != 0) {
+			alloca_body(alloca_i);
+			abort();
+		}
+		volatile char *p = alloca(BENCH_SMALL_STACK);
+		p[0] = 0;
+	}
+	alloca_res->spawn = bench_avg(start, alloca_count);
+	start = bench_clock();
+	if (setjmp(alloca_done) == 0) {
+		alloca_i = 0;
+		longjmp(alloca_coros[0].ctx, 1);
+	}
+	alloca_res->yield = bench_avg(start,
+				      (uint64_t) alloca_count * alloca_rounds);
+	alloca_res->memory = ((double) bench_rss() - rss) / alloca_count;
+	/* Stacks are freed together with the frame. */
+	alloca_res->teardown = 0;
+	return NULL;
+}
+
+static void
+bench_alloca(int count, int rounds, struct bench_result *res)
+{
+	alloca_count = count;
+	alloca_rounds = rounds;
+	alloca_res = res;
+	alloca_coros = (struct alloca_coro *) malloc(count *
+						     sizeof(alloca_coros[0]));
+	if (alloca_coros == NULL) {
+		res->skip_reason = "no memory";
+		return;
+	}
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	/* Each coroutine takes a bit more, than its alloca. */
+	size_t stack_size = (size_t) count * (BENCH_SMALL_STACK + 1024) +
+			    BENCH_BIG_STACK;
+	pthread_t t;
+	if (pthread_attr_setstacksize(&attr, stack_size) != 0 ||
+	    pthread_create(&t, &attr, alloca_run, NULL) != 0)
+		res->skip_reason = "no thread";
+	else
+		pthread_join(t, NULL);
+	pthread_attr_destroy(&attr);
+	free(alloca_coros);
+}
+
+/* }}} */
+
+/* {{{ sigaltstack, lecture_examples/4_signals/12_libcoro.c */
+
+static int libcoro_rounds;
+
+static int
+libcoro_body(void *arg)
+{
+	(void) arg;
+	for (int r = 0; r < libcoro_rounds; ++r)
+		coro_yield();
+	return 0;
+}
+
+static void
+bench_libcoro_mode(int count, int rounds, struct bench_result *res,
+		   enum coro_stack_mode mode, size_t max_size)
+{
+	if (mode == CORO_STACK_GROWABLE &&
+	    bench_growable_map_count() * count + 1000 >
+	    bench_max_map_count()) {
+		res->skip_reason = "vm.max_map_count";
+		return;
+	}
+	struct coro **coros = (struct coro **) malloc(count * sizeof(coros[0]));
+	if (coros == NULL) {
+		res->skip_reason = "no memory";
+		return;
+	}
+	libcoro_rounds = rounds;
+	coro_sched_init(CORO_SCHED_ROUND_ROBIN);
+	coro_stack_mode_set(mode, max_size);
+	size_t rss = bench_rss();
+	uint64_t start = bench_clock();
+	for (int i = 0; i < count; ++i)
+		coro_new(libcoro_body, NULL);
+	res->spawn = bench_avg(start, count);
+	start = bench_clock();
+	int finished = 0;
+	struct coro *c;
+	while ((c = coro_sched_wait()) != NULL)
+		coros[finished++] = c;
+	res->yield = bench_avg(start, (uint64_t) count * rounds);
+	res->memory = ((double) bench_rss() - rss) / count;
+	start = bench_clock();
+	for (int i = 0; i < finished; ++i)
+		coro_delete(coros[i]);
+	res->teardown = bench_avg(start, count);
+	free(coros);
+}
+
+static void
+bench_libcoro(int count, int rounds, struct bench_result *res)
+{
+	bench_libcoro_mode(count, rounds, res, CORO_STACK_FIXED, 0);
+}
+
+static void
+bench_libcoro_growable(int count, int rounds, struct bench_result *res)
+{
+	bench_libcoro_mode(count, rounds, res, CORO_STACK_GROWABLE,
+			   BENCH_GROWABLE_STACK);
+}
+
+/* }}} */
+
+typedef void (*bench_f)(int count, int rounds, struct bench_result *res);
+
+static const struct {
+	const char *name;
+	bench_f func;
+} benches[] = {
+	{"swapcontext", bench_uctx},
+	{"setjmp+alloca", bench_alloca},
+	{"sigaltstack", bench_libcoro},
+	{"sigaltstack+grow", bench_libcoro_growable},
+	{"setjmp coro_jmp.h", bench_jmp},
+};
+
+int
+main(void)
+{
+	const int counts[] = {1000, 10 * 1000, BENCH_COUNT_MAX};
+	/*
+	 * 1MB stacks are allocated from the heap, not by a
+	 * separate mmap() each, to fit into vm.max_map_count with
+	 * 100k coroutines. Only touched pages take RSS anyway.
+	 */
+	mallopt(M_MMAP_THRESHOLD, 32 * 1024 * 1024);
+	printf("%-18s %7s %10s %10s %10s %10s\n", "implementation",
+	       "coros", "spawn ns", "switch ns", "free ns", "mem B");
+	for (size_t b = 0; b < sizeof(benches) / sizeof(benches[0]); ++b) {
+		for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]);
+		     ++i) {
+			int count = counts[i];
+			int rounds = BENCH_SWITCHES / count;
+			if (rounds < 2)
+				rounds = 2;
+			struct bench_result res;
+			memset(&res, 0, sizeof(res));
+			benches[b].func(count, rounds, &res);
+			if (res.skip_reason != NULL) {
+				printf("%-18s %7d skipped: %s\n",
+				       benches[b].name, count,
+				       res.skip_reason);
+				continue;
+			}
+			printf("%-18s %7d %10.1f %10.1f %10.1f %10.0f\n",
+			       benches[b].name, count, res.spawn, res.yield,
+			       res.teardown, res.memory);
+		}
+	}
+	return 0;
+}
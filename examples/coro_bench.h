@@ -0,0 +1,42 @@
+#ifndef CORO_BENCH_INCLUDED
+#define CORO_BENCH_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum {
+	/** The biggest coroutine count, used by the benchmark. */
+	BENCH_COUNT_MAX = 100 * 1000,
+};
+
+/** Result of one benchmark run. Times are in nanoseconds. */
+struct bench_result {
+	/** Average time to create one coroutine. */
+	double spawn;
+	/** Average time of one switch between coroutines. */
+	double yield;
+	/** Average time to destroy one finished coroutine. */
+	double teardown;
+	/** Average RSS growth per one coroutine, bytes. */
+	double memory;
+	/** Why the run was skipped. NULL, if it was not. */
+	const char *skip_reason;
+};
+
+/** Monotonic time in nanoseconds. */
+uint64_t
+bench_clock(void);
+
+/** Resident set size of the process in bytes. */
+size_t
+bench_rss(void);
+
+/**
+ * Benchmark of setjmp coroutines from 1/coro_jmp.h. It lives in
+ * a separate file, because coro_jmp.h and libcoro both define
+ * struct coro.
+ */
+void
+bench_jmp(int count, int rounds, struct bench_result *res);
+
+#endif /* CORO_BENCH_INCLUDED */
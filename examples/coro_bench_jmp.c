@@ -0,0 +1,86 @@
+#include "coro_bench.h"
+
+static int jmp_count;
+#define coro_count jmp_count
+#define CORO_COUNT_MAX BENCH_COUNT_MAX
+#include "coro_jmp.h"
+
+/**
+ * All the coroutines share one stack frame, so the state is
+ * either global or coroutine-local.
+ */
+struct jmp_bench_data {
+	/** How many times the coroutine has yielded. */
+	int round;
+};
+
+static coro_key_t jmp_key;
+static bool is_jmp_key_created = false;
+static int jmp_rounds;
+static int jmp_finished;
+static bool is_jmp_started;
+static uint64_t jmp_switches;
+static uint64_t jmp_start;
+static size_t jmp_rss;
+static struct bench_result *jmp_res;
+
+static void
+jmp_bench_body(void)
+{
+	while (coro_local(jmp_key, struct jmp_bench_data)->round++ <
+	       jmp_rounds) {
+		++jmp_switches;
+		coro_yield();
+	}
+	coro_finish();
+	++jmp_finished;
+	while (jmp_finished < jmp_count) {
+		++jmp_switches;
+		coro_yield();
+	}
+}
+
+void
+bench_jmp(int count, int rounds, struct bench_result *res)
+{
+	if (! is_jmp_key_created) {
+		coro_key_create(&jmp_key, sizeof(struct jmp_bench_data),
+				NULL);
+		is_jmp_key_created = true;
+	}
+	jmp_count = count;
+	jmp_rounds = rounds;
+	jmp_finished = 0;
+	jmp_switches = 0;
+	jmp_res = res;
+	is_jmp_started = false;
+	curr_coro_i = 0;
+	jmp_rss = bench_rss();
+	jmp_start = bench_clock();
+	for (int i = 0; i < jmp_count; ++i) {
+		if (coro_init(&coros[i]) != 0)
+			break;
+	}
+	/*
+	 * Each coroutine starts here on its first schedule. Local
+	 * variables are not valid after the jumps - use only the
+	 * global ones.
+	 */
+	if (! is_jmp_started) {
+		is_jmp_started = true;
+		jmp_res->spawn = (double) (bench_clock() - jmp_start) /
+				 jmp_count;
+		jmp_start = bench_clock();
+	}
+	jmp_bench_body();
+	jmp_res->yield = (double) (bench_clock() - jmp_start) /
+			 jmp_switches;
+	jmp_res->memory = ((double) bench_rss() - jmp_rss) / jmp_count;
+	jmp_start = bench_clock();
+	for (int i = 0; i < jmp_count; ++i) {
+		free(coros[i].ret_points);
+		coros[i].ret_points = NULL;
+	}
+	jmp_res->teardown = (double) (bench_clock() - jmp_start) /
+			    jmp_count;
+}
@@ -1,20 +1,42 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
 #include "12_libcoro.h"
 
+#ifndef MADV_GUARD_INSTALL
+/* Linux 6.13+, the headers can be older. */
+#define MADV_GUARD_INSTALL 102
+#endif
+
 #define handle_error() ({printf("Error %s\n", strerror(errno)); exit(-1);})
 
+enum {
+	/** Stack size of coroutines in the fixed stack mode. */
+	CORO_STACK_FIXED_SIZE = 1024 * 1024,
+	/** Weight of a coroutine in the fair scheduler by default. */
+	CORO_WEIGHT_DEFAULT = 100,
+	/** Latency target of a coroutine by default, microseconds. */
+	CORO_LATENCY_DEFAULT = 100 * 1000,
+};
+
 /** Main coroutine structure, its context. */
 struct coro {
 	/** A value, returned by func. */
 	int ret;
 	/** Stack, used by the coroutine. */
 	void *stack;
+	/** Full stack size including the guard page. */
+	size_t stack_size;
+	/** How the stack was allocated. */
+	enum coro_stack_mode stack_mode;
 	/** An argument for the function func. */
 	void *func_arg;
 	/** A function to call as a coroutine. */
@@ -23,8 +45,34 @@ struct coro {
 	sigjmp_buf ctx;
 	/** True, if the coroutine has finished. */
 	bool is_finished;
-	/** Links in the coroutine list, used by scheduler. */
+	/**
+	 * Links in the coroutine list, used by scheduler. When
+	 * the coroutine is finished, it is removed from that list
+	 * and 'next' is reused to link it into the finished
+	 * queue.
+	 */
 	struct coro *next, *prev;
+	/** Priority for CORO_SCHED_PRIORITY. Bigger runs first. */
+	int priority;
+	/** Share of CPU time for CORO_SCHED_FAIR. */
+	int weight;
+	/** Latency target for CORO_SCHED_DEADLINE, microseconds. */
+	uint64_t latency;
+	/**
+	 * Fair scheduler only: time spent by the coroutine,
+	 * divided by its weight.
+	 */
+	uint64_t vruntime;
+	/** When the coroutine got CPU last time, microseconds. */
+	uint64_t run_start;
+	/**
+	 * Place in the ready queue: the smallest key is the next
+	 * to run. Sequence number breaks ties in the FIFO order.
+	 */
+	int64_t key;
+	uint64_t seq;
+	/** Index in the ready heap, or -1, if not in it. */
+	int heap_idx;
 };
 
 /**
@@ -39,14 +87,47 @@ static struct coro coro_sched;
 static bool is_sched_waiting = false;
 /** Which coroutine works at this moment. */
 static struct coro *coro_this_ptr = NULL;
-/** List of all the coroutines. */
+/** List of all the not finished coroutines. */
 static struct coro *coro_list = NULL;
+/**
+ * Queue of finished, but not yet returned to a user coroutines.
+ * A coroutine puts itself here on finish, so the scheduler
+ * does not need to scan the whole coroutine list to find one.
+ */
+static struct coro *finished_head = NULL;
+static struct coro *finished_tail = NULL;
+/** Policy, chosen on the scheduler initialization. */
+static enum coro_sched_policy sched_policy = CORO_SCHED_ROUND_ROBIN;
+/**
+ * Any policy except round-robin keeps all not running and not
+ * finished coroutines in a binary heap, ordered by key.
+ */
+static struct coro **ready_heap = NULL;
+static int ready_count = 0;
+static int ready_capacity = 0;
+/** Counter to order coroutines with equal keys. */
+static uint64_t ready_seq = 0;
+/**
+ * Fair scheduler only: vruntime of the last scheduled
+ * coroutine. New coroutines start from it, so as not to
+ * monopolize CPU while catching up the old ones.
+ */
+static uint64_t fair_clock = 0;
 /**
  * Buffer, used by the coroutine constructor to escape from the
  * signal handler back into the constructor to rollback
  * sigaltstack etc.
  */
 static sigjmp_buf start_point;
+/** Stack mode for new coroutines. */
+static enum coro_stack_mode stack_mode = CORO_STACK_FIXED;
+/** Maximal size of a growable stack, including the guard page. */
+static size_t stack_max_size = CORO_STACK_FIXED_SIZE;
+/**
+ * Stack for the SIGSEGV handler. It can not work on the
+ * faulted stack - it has no free space by definition.
+ */
+static void *fault_stack = NULL;
 
 /** Add a new coroutine to the beginning of the list. */
 static void
@@ -72,6 +153,33 @@ coro_list_delete(struct coro *c)
 		coro_list = next;
 }
 
+/** Add a finished coroutine to the end of the finished queue. */
+static void
+coro_finished_push(struct coro *c)
+{
+	c->next = NULL;
+	c->prev = NULL;
+	if (finished_tail != NULL)
+		finished_tail->next = c;
+	else
+		finished_head = c;
+	finished_tail = c;
+}
+
+/** Take the oldest finished coroutine. NULL, if no ones. */
+static struct coro *
+coro_finished_pop(void)
+{
+	struct coro *c = finished_head;
+	if (c == NULL)
+		return NULL;
+	finished_head = c->next;
+	if (finished_head == NULL)
+		finished_tail = NULL;
+	c->next = NULL;
+	return c;
+}
+
 int
 coro_status(const struct coro *c)
 {
@@ -87,15 +195,258 @@ coro_is_finished(const struct coro *c)
 void
 coro_delete(struct coro *c)
 {
-	free(c->stack);
+	if (c->stack_mode == CORO_STACK_GROWABLE)
+		munmap(c->stack, c->stack_size);
+	else
+		free(c->stack);
 	free(c);
 }
 
+static size_t
+page_round_up(size_t size)
+{
+	size_t page = getpagesize();
+	return (size + page - 1) / page * page;
+}
+
+/**
+ * SIGSEGV handler for growable stacks. A fault in the lowest
+ * page of the current coroutine stack - the guard - means the
+ * coroutine used the whole stack, and the process is aborted
+ * with a message. Other faults are not related to coroutines
+ * and lead to the default action.
+ */
+static void
+coro_stack_fault(int signum, siginfo_t *info, void *context)
+{
+	(void) context;
+	struct coro *c = coro_this_ptr;
+	char *addr = (char *) info->si_addr;
+	if (c == NULL || c->stack_mode != CORO_STACK_GROWABLE ||
+	    addr < (char *) c->stack ||
+	    addr >= (char *) c->stack + c->stack_size)
+		goto not_mine;
+	size_t page = getpagesize();
+	if (addr < (char *) c->stack + page) {
+		char msg[128];
+		int len = snprintf(msg, sizeof(msg), "Coroutine %p stack "\
+				   "overflow, max stack size is %zu\n",
+				   c, c->stack_size - page);
+		write(STDERR_FILENO, msg, len);
+		abort();
+	}
+not_mine:
+	signal(signum, SIG_DFL);
+}
+
+void
+coro_stack_mode_set(enum coro_stack_mode mode, size_t max_size)
+{
+	stack_mode = mode;
+	if (mode == CORO_STACK_FIXED)
+		return;
+	if (max_size == 0)
+		max_size = CORO_STACK_FIXED_SIZE;
+	/* One more page for the guard. */
+	stack_max_size = page_round_up(max_size) + getpagesize();
+	if (fault_stack != NULL)
+		return;
+	fault_stack = malloc(SIGSTKSZ);
+	if (fault_stack == NULL)
+		handle_error();
+	stack_t st;
+	st.ss_sp = fault_stack;
+	st.ss_size = SIGSTKSZ;
+	st.ss_flags = 0;
+	if (sigaltstack(&st, NULL) != 0)
+		handle_error();
+	struct sigaction sa;
+	sa.sa_sigaction = coro_stack_fault;
+	sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGSEGV, &sa, NULL) != 0)
+		handle_error();
+}
+
+/**
+ * Allocate a stack for a new coroutine according to the current
+ * stack mode. A growable stack is mapped at the full size
+ * without a swap reservation, so the kernel gives it memory only
+ * when a page is touched. The lowest page is the guard. A guard
+ * region of madvise() does not split the mapping, and adjacent
+ * stacks even share one. Only on an old kernel the guard is a
+ * PROT_NONE page, and a stack takes 2 mappings.
+ */
+static void
+coro_stack_new(struct coro *c)
+{
+	c->stack_mode = stack_mode;
+	if (stack_mode == CORO_STACK_FIXED) {
+		c->stack_size = CORO_STACK_FIXED_SIZE;
+		if (c->stack_size < SIGSTKSZ)
+			c->stack_size = SIGSTKSZ;
+		c->stack = malloc(c->stack_size);
+		if (c->stack == NULL)
+			handle_error();
+		return;
+	}
+	c->stack_size = stack_max_size;
+	c->stack = mmap(NULL, c->stack_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (c->stack == MAP_FAILED)
+		handle_error();
+	if (madvise(c->stack, getpagesize(), MADV_GUARD_INSTALL) != 0 &&
+	    mprotect(c->stack, getpagesize(), PROT_NONE) != 0)
+		handle_error();
+}
+
+/** Monotonic time in microseconds. */
+static uint64_t
+coro_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline bool
+ready_less(const struct coro *a, const struct coro *b)
+{
+	return a->key < b->key || (a->key == b->key && a->seq < b->seq);
+}
+
+static inline void
+ready_set(int i, struct coro *c)
+{
+	ready_heap[i] = c;
+	c->heap_idx = i;
+}
+
+static void
+ready_sift_up(int i)
+{
+	struct coro *c = ready_heap[i];
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (! ready_less(c, ready_heap[parent]))
+			break;
+		ready_set(i, ready_heap[parent]);
+		i = parent;
+	}
+	ready_set(i, c);
+}
+
+static void
+ready_sift_down(int i)
+{
+	struct coro *c = ready_heap[i];
+	while (true) {
+		int child = 2 * i + 1;
+		if (child >= ready_count)
+			break;
+		if (child + 1 < ready_count &&
+		    ready_less(ready_heap[child + 1], ready_heap[child]))
+			++child;
+		if (! ready_less(ready_heap[child], c))
+			break;
+		ready_set(i, ready_heap[child]);
+		i = child;
+	}
+	ready_set(i, c);
+}
+
+/** Calculate the ready queue key according to the policy. */
+static void
+ready_key_update(struct coro *c)
+{
+	switch (sched_policy) {
+	case CORO_SCHED_PRIORITY:
+		c->key = -(int64_t) c->priority;
+		break;
+	case CORO_SCHED_FAIR:
+		c->key = c->vruntime;
+		break;
+	case CORO_SCHED_DEADLINE:
+		c->key = coro_clock() + c->latency;
+		break;
+	default:
+		c->key = 0;
+	}
+}
+
+/** Put a coroutine into the ready queue. */
+static void
+ready_push(struct coro *c)
+{
+	if (ready_count == ready_capacity) {
+		ready_capacity = (ready_capacity + 1) * 2;
+		ready_heap = (struct coro **) realloc(ready_heap,
+			ready_capacity * sizeof(ready_heap[0]));
+		if (ready_heap == NULL)
+			handle_error();
+	}
+	ready_key_update(c);
+	c->seq = ready_seq++;
+	ready_set(ready_count++, c);
+	ready_sift_up(c->heap_idx);
+}
+
+/** Take a coroutine with the smallest key from the ready queue. */
+static struct coro *
+ready_pop(void)
+{
+	if (ready_count == 0)
+		return NULL;
+	struct coro *c = ready_heap[0];
+	c->heap_idx = -1;
+	if (--ready_count > 0) {
+		ready_set(0, ready_heap[ready_count]);
+		ready_sift_down(0);
+	}
+	if (sched_policy == CORO_SCHED_FAIR)
+		fair_clock = c->vruntime;
+	return c;
+}
+
+/** Re-calculate key of a coroutine, if it is in the ready queue. */
+static void
+ready_update(struct coro *c)
+{
+	if (c->heap_idx < 0)
+		return;
+	ready_key_update(c);
+	ready_sift_up(c->heap_idx);
+	ready_sift_down(c->heap_idx);
+}
+
+void
+coro_set_priority(struct coro *c, int priority)
+{
+	c->priority = priority;
+	ready_update(c);
+}
+
+void
+coro_set_weight(struct coro *c, int weight)
+{
+	c->weight = weight > 0 ? weight : 1;
+	ready_update(c);
+}
+
+void
+coro_set_latency(struct coro *c, uint64_t latency)
+{
+	c->latency = latency;
+	ready_update(c);
+}
+
 /** Switch the current coroutine to an arbitrary one. */
 static void
 coro_yield_to(struct coro *to)
 {
 	struct coro *from = coro_this_ptr;
+	if (sched_policy == CORO_SCHED_FAIR)
+		to->run_start = coro_clock();
 	if (sigsetjmp(from->ctx, 0) == 0)
 		siglongjmp(to->ctx, 1);
 	coro_this_ptr = from;
@@ -105,35 +456,58 @@ void
 coro_yield(void)
 {
 	struct coro *from = coro_this_ptr;
-	struct coro *to = from->next;
-	if (to == NULL)
-		coro_yield_to(&coro_sched);
-	else
+	if (sched_policy == CORO_SCHED_ROUND_ROBIN) {
+		struct coro *to = from->next;
+		if (to == NULL)
+			coro_yield_to(&coro_sched);
+		else
+			coro_yield_to(to);
+		return;
+	}
+	if (ready_count == 0)
+		return;
+	if (sched_policy == CORO_SCHED_FAIR) {
+		from->vruntime += (coro_clock() - from->run_start) *
+				  CORO_WEIGHT_DEFAULT / from->weight;
+	}
+	ready_push(from);
+	struct coro *to = ready_pop();
+	if (to != from)
 		coro_yield_to(to);
+	else if (sched_policy == CORO_SCHED_FAIR)
+		from->run_start = coro_clock();
 }
 
 void
-coro_sched_init(void)
+coro_sched_init(enum coro_sched_policy policy)
 {
 	memset(&coro_sched, 0, sizeof(coro_sched));
+	coro_sched.heap_idx = -1;
 	coro_this_ptr = &coro_sched;
+	finished_head = NULL;
+	finished_tail = NULL;
+	sched_policy = policy;
+	ready_count = 0;
+	ready_seq = 0;
+	fair_clock = 0;
 }
 
 struct coro *
 coro_sched_wait(void)
 {
-	while (coro_list != NULL) {
-		for (struct coro *c = coro_list; c != NULL; c = c->next) {
-			if (c->is_finished) {
-				coro_list_delete(c);
-				return c;
-			}
-		}
+	while (true) {
+		struct coro *c = coro_finished_pop();
+		if (c != NULL)
+			return c;
+		if (coro_list == NULL)
+			return NULL;
 		is_sched_waiting = true;
-		coro_yield_to(coro_list);
+		if (sched_policy == CORO_SCHED_ROUND_ROBIN)
+			coro_yield_to(coro_list);
+		else
+			coro_yield_to(ready_pop());
 		is_sched_waiting = false;
 	}
-	return NULL;
 }
 
 struct coro *
@@ -166,6 +540,13 @@ coro_body(int signum)
 	coro_this_ptr = c;
 	c->ret = c->func(c->func_arg);
 	c->is_finished = true;
+	/*
+	 * Leave the list of active coroutines right now - the
+	 * scheduler takes finished ones from the queue without
+	 * any search.
+	 */
+	coro_list_delete(c);
+	coro_finished_push(c);
 	/* Can not return - 'ret' address is invalid already! */
 	if (! is_sched_waiting) {
 		printf("Critical error - no place to return!\n");
@@ -179,13 +560,15 @@ coro_new(coro_f func, void *func_arg)
 {
 	struct coro *c = (struct coro *) malloc(sizeof(*c));
 	c->ret = 0;
-	int stack_size = 1024 * 1024;
-	if (stack_size < SIGSTKSZ)
-		stack_size = SIGSTKSZ;
-	c->stack = malloc(stack_size);
+	coro_stack_new(c);
 	c->func = func;
 	c->func_arg = func_arg;
 	c->is_finished = false;
+	c->priority = 0;
+	c->weight = CORO_WEIGHT_DEFAULT;
+	c->latency = CORO_LATENCY_DEFAULT;
+	c->vruntime = fair_clock;
+	c->heap_idx = -1;
 	/*
 	 * SIGUSR2 is used. First of all, block new signals to be
 	 * able to set a new handler.
@@ -209,7 +592,7 @@ coro_new(coro_f func, void *func_arg)
 	/* Create that new stack. */
 	stack_t oldst, newst;
 	newst.ss_sp = c->stack;
-	newst.ss_size = stack_size;
+	newst.ss_size = c->stack_size;
 	newst.ss_flags = 0;
 	if (sigaltstack(&newst, &oldst) != 0)
 		handle_error();
@@ -244,5 +627,7 @@ coro_new(coro_f func, void *func_arg)
 
 	/* Now scheduler can work with that coroutine. */
 	coro_list_add(c);
+	if (sched_policy != CORO_SCHED_ROUND_ROBIN)
+		ready_push(c);
 	return c;
 }
@@ -2,17 +2,70 @@
 #define LIBCORO_INCLUDED
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 struct coro;
 typedef int (*coro_f)(void *);
 
-/** Make current context scheduler. */
+/** How stacks of new coroutines are allocated. */
+enum coro_stack_mode {
+	/** Fixed 1MB malloc-ed stack. It is default. */
+	CORO_STACK_FIXED,
+	/**
+	 * The whole stack is mapped without a swap reservation,
+	 * and the kernel gives memory to a page on the first touch,
+	 * so RSS is proportional to really used stack. A fault in
+	 * the lowest guard page aborts the process with a message
+	 * about the overflow. Since Linux 6.13 the guard does not
+	 * take a memory mapping, otherwise each stack takes 2 of
+	 * them, and their count is limited by vm.max_map_count.
+	 */
+	CORO_STACK_GROWABLE,
+};
+
+/**
+ * Set stack mode for coroutines, created after that call.
+ * @param mode Stack mode.
+ * @param max_size Maximal size of a growable stack. 0 means
+ *        the same size as a fixed stack has.
+ */
+void
+coro_stack_mode_set(enum coro_stack_mode mode, size_t max_size);
+
+/** How the scheduler chooses a next coroutine on yield. */
+enum coro_sched_policy {
+	/** Each coroutine works in turn. */
+	CORO_SCHED_ROUND_ROBIN,
+	/**
+	 * A coroutine with the biggest priority works. Ones
+	 * with equal priorities work in turn.
+	 */
+	CORO_SCHED_PRIORITY,
+	/**
+	 * A coroutine with the smallest work time divided by its
+	 * weight works. So CPU time is shared proportionally to
+	 * the weights.
+	 */
+	CORO_SCHED_FAIR,
+	/**
+	 * Earliest deadline first. A deadline of a coroutine is
+	 * the moment it yielded plus its latency target.
+	 */
+	CORO_SCHED_DEADLINE,
+};
+
+/**
+ * Make current context scheduler. A scheduling policy is chosen
+ * here and is used until a next initialization.
+ */
 void
-coro_sched_init(void);
+coro_sched_init(enum coro_sched_policy policy);
 
 /**
  * Block until any coroutine has finished. It is returned. NULl,
- * if no coroutines.
+ * if no coroutines. Finished coroutines are returned in the
+ * order they have finished, each in O(1).
  */
 struct coro *
 coro_sched_wait(void);
@@ -28,6 +81,21 @@ coro_this(void);
 struct coro *
 coro_new(coro_f func, void *func_arg);
 
+/** Set priority for CORO_SCHED_PRIORITY. 0 by default. */
+void
+coro_set_priority(struct coro *c, int priority);
+
+/** Set weight for CORO_SCHED_FAIR. 100 by default. */
+void
+coro_set_weight(struct coro *c, int weight);
+
+/**
+ * Set latency target in microseconds for CORO_SCHED_DEADLINE.
+ * 100ms by default.
+ */
+void
+coro_set_latency(struct coro *c, uint64_t latency);
+
 /** Return status of the coroutine. */
 int
 coro_status(const struct coro *c);
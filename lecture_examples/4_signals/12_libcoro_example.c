@@ -27,6 +27,30 @@ coro_func(void *ptr)
 	return id;
 }
 
+static int
+deep_recursive(int deep, int id)
+{
+	/* Eat some stack on each step. */
+	volatile char data[8 * 1024];
+	data[0] = deep;
+	if (deep == 0) {
+		printf("%d: the deepest point\n", id);
+		coro_yield();
+		return data[0];
+	}
+	return deep_recursive(deep - 1, id) + data[0];
+}
+
+static int
+coro_deep_func(void *ptr)
+{
+	int id = (int) ptr;
+	printf("%d: coro with growable stack is started\n", id);
+	coro_yield();
+	printf("%d: recursion sum %d\n", id, deep_recursive(10, id));
+	return id;
+}
+
 static int
 coro_tree_func(void *ptr)
 {
@@ -47,7 +71,7 @@ int
 main(void)
 {
 	printf("Start main\n");
-	coro_sched_init();
+	coro_sched_init(CORO_SCHED_ROUND_ROBIN);
 	for (int i = 0; i < coro_count; ++i)
 		coros[i] = coro_new(coro_func, (void *) i);
 	struct coro *c;
@@ -62,6 +86,33 @@ main(void)
 		printf("Finished %d\n", coro_status(c));
 		coro_delete(c);
 	}
+	printf("Finished tree\n");
+
+	/*
+	 * Stacks, which take memory only for the pages the
+	 * recursion really touches.
+	 */
+	coro_stack_mode_set(CORO_STACK_GROWABLE, 256 * 1024);
+	for (int i = 0; i < coro_count; ++i)
+		coros[i] = coro_new(coro_deep_func, (void *) i);
+	while ((c = coro_sched_wait()) != NULL) {
+		printf("Finished %d\n", coro_status(c));
+		coro_delete(c);
+	}
+	printf("Finished growable\n");
+
+	/*
+	 * The last coroutine is more important - it works until
+	 * finish, and only then the others get CPU.
+	 */
+	coro_sched_init(CORO_SCHED_PRIORITY);
+	for (int i = 0; i < coro_count; ++i)
+		coros[i] = coro_new(coro_func, (void *) i);
+	coro_set_priority(coros[coro_count - 1], 1);
+	while ((c = coro_sched_wait()) != NULL) {
+		printf("Finished %d\n", coro_status(c));
+		coro_delete(c);
+	}
 	printf("Finish main\n");
 	return 0;
 }